@@ -1,4 +1,5 @@
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>
 #include <stdio.h>
 #include <string>
 #include <string.h>
@@ -7,13 +8,43 @@
 #include <pthread.h>
 #include <iostream>
 #include "sql_connection_pool.h"
+#include "../log/log.h"
+#include "../timer/coarse_clock.h"
 
 using namespace std;
 
+static const int CONNECT_TIMEOUT = 3;					//建立连接的超时(秒)
+static const long long PING_INTERVAL = 30 * 1000000LL;	//空闲连接超过这么久没有使用就 ping 一次
+static const long long IDLE_TIMEOUT = 60 * 1000000LL;	//多于 MinConn 的连接空闲这么久后关闭
+static const long long GROW_WAIT_US = 1000;				//一个维护周期内平均等待超过 1ms 时增加一条连接
+static const long long STATS_INTERVAL = 60 * 1000000LL;
+
+static string stmt_text(SQL_STMT id)
+{
+	if (id == STMT_INSERT_USER)
+		return "INSERT INTO user(username, passwd) VALUES(?, ?)";
+	string sql = "INSERT IGNORE INTO user(username, passwd) VALUES(?, ?)";
+	for (int i = 1; i < 1 << (id - STMT_INSERT_USERS_1); ++i)
+		sql += ",(?, ?)";
+	return sql;
+}
+
 connection_pool::connection_pool()
 {
+	this->MaxConn = 0;
+	this->MinConn = 0;
 	this->CurConn = 0;
 	this->FreeConn = 0;
+	this->Pending = 0;
+	this->Dedicated = 0;
+	this->Timeout = -1;
+	this->Waiting = 0;
+	this->Port = 0;
+	memset(&stats, 0, sizeof(stats));
+	waitSum = 0;
+	waitCount = 0;
+	maintStarted = false;
+	stopping = false;
 }
 
 connection_pool *connection_pool::GetInstance()  // 数据库连接池 是 单例模式，所有类对象共享同一个函数
@@ -22,8 +53,55 @@ connection_pool *connection_pool::GetInstance()  // 数据库连接池 是 单
 	return &connPool;
 }
 
+//建立一条新连接，不持有 lock 时调用
+MYSQL *connection_pool::Connect()
+{
+	MYSQL *con = mysql_init(NULL);
+	if (con == NULL)
+		return NULL;
+	unsigned int timeout = CONNECT_TIMEOUT;
+	mysql_options(con, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+	if (mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DatabaseName.c_str(), Port, NULL, 0) == NULL)
+	{
+		LOG_ERROR("mysql connect error: %s", mysql_error(con));
+		mysql_close(con);
+		return NULL;
+	}
+	return con;
+}
+
+//关闭连接及其预编译语句，不持有 lock 时调用
+void connection_pool::CloseConn(MYSQL *con)
+{
+	vector<MYSQL_STMT *> stmts;
+	lock.lock();
+	map<MYSQL *, conn_info>::iterator it = connInfo.find(con);
+	if (it != connInfo.end())
+	{
+		stmts.swap(it->second.stmts);
+		connInfo.erase(it);
+	}
+	lock.unlock();
+	for (size_t i = 0; i < stmts.size(); ++i)
+		if (stmts[i])
+			mysql_stmt_close(stmts[i]);
+	mysql_close(con);
+}
+
+//把新连接放入空闲链表，持有 lock 时调用
+void connection_pool::AddConn(MYSQL *con)
+{
+	conn_info &info = connInfo[con];
+	info.used = info.checked = coarse_clock::monotonic_us();
+	info.stmts.assign(STMT_COUNT, (MYSQL_STMT *)NULL);
+	connList.push_back(con);
+	++FreeConn;
+	freeCond.signal();
+}
+
 //构造初始化
-void connection_pool::init(string url, string User, string PassWord, string DBName, int Port, unsigned int MaxConn)
+bool connection_pool::init(string url, string User, string PassWord, string DBName, int Port, unsigned int MaxConn,
+						   unsigned int MinConn, int timeout_ms)
 {
 	//初始化数据库信息
 	this->url = url;
@@ -31,59 +109,89 @@ void connection_pool::init(string url, string User, string PassWord, string DBNa
 	this->User = User;
 	this->PassWord = PassWord;
 	this->DatabaseName = DBName;
+	this->MaxConn = MaxConn;
+	this->MinConn = MinConn == 0 || MinConn > MaxConn ? MaxConn : MinConn;
+	this->Timeout = timeout_ms;
 
-	lock.lock();  // 使用 互斥锁保证线程安全
-	//创建MaxConn条数据库连接
-	for (int i = 0; i < MaxConn; i++)
+	//先建立 MinConn 条连接，数据库不可用时不再继续尝试，交给后台线程
+	for (unsigned int i = 0; i < this->MinConn; i++)
 	{
-		MYSQL *con = NULL;
-		con = mysql_init(con);
-
-		if (con == NULL)
-		{
-			cout << "Error:" << mysql_error(con);
-			exit(1);
-		}
-		con = mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DBName.c_str(), Port, NULL, 0);
-
+		MYSQL *con = Connect();
 		if (con == NULL)
-		{
-			cout << "Error: " << mysql_error(con);
-			exit(1);
-		}
-
-		//更新连接池和空闲连接数量
-		// for 循环 不断将新创建的con连接 放入 list链表中
-		connList.push_back(con);
-		++FreeConn;
+			break;
+		lock.lock();  // 使用 互斥锁保证线程安全
+		AddConn(con);
+		lock.unlock();
 	}
 
-//将信号量初始化为最大连接次数
-	reserve = sem(FreeConn);
+	if (pthread_create(&maintTid, NULL, Maintain, this) == 0)
+		maintStarted = true;
+	return GetFreeConn() > 0;
+}
 
-	this->MaxConn = FreeConn;
-	
-	lock.unlock();
+//持有 lock 时调用
+void connection_pool::AddWait(long long us)
+{
+	static const long long bounds[pool_stats::WAIT_BUCKETS - 1] = {100, 1000, 10000, 100000, 1000000};
+	int b = 0;
+	while (b < pool_stats::WAIT_BUCKETS - 1 && us >= bounds[b])
+		++b;
+	++stats.wait_hist[b];
+	waitSum += us;
+	++waitCount;
 }
 
+MYSQL *connection_pool::GetConnection()
+{
+	return GetConnection(Timeout);
+}
 
 //当有请求时，从数据库连接池中返回一个可用连接，更新使用和空闲连接数
-MYSQL *connection_pool::GetConnection()
+//没有空闲连接时最多等待 timeout_ms 毫秒
+MYSQL *connection_pool::GetConnection(int timeout_ms)
 {
 	MYSQL *con = NULL;
+	long long start = coarse_clock::monotonic_us();
+	struct timespec deadline;
+	if (timeout_ms > 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
 
-	if (0 == connList.size())
-		return NULL;
-
-	reserve.wait();          // 信号量
-	
 	lock.lock();
+	//没有空闲连接且未到上限时让后台线程立即建立新连接，不必等下一轮维护
+	if (connList.empty() && timeout_ms != 0 && CurConn + FreeConn + Pending < MaxConn)
+		maintCond.signal();
+	while (connList.empty() && timeout_ms != 0 && !stopping)
+	{
+		++Waiting;
+		bool ok = timeout_ms < 0 ? freeCond.wait(lock.get()) : freeCond.timewait(lock.get(), deadline);
+		--Waiting;
+		if (!ok && timeout_ms > 0)
+			break;
+	}
+	if (connList.empty())
+	{
+		++stats.timeouts;
+		AddWait(coarse_clock::monotonic_us() - start);
+		lock.unlock();
+		return NULL;
+	}
 
 	con = connList.front();
 	connList.pop_front();
 
 	--FreeConn;
 	++CurConn;
+	++stats.acquires;
+	AddWait(coarse_clock::monotonic_us() - start);
 
 	lock.unlock();
 	return con;
@@ -95,48 +203,273 @@ bool connection_pool::ReleaseConnection(MYSQL *con)
 	if (NULL == con)
 		return false;
 
-	lock.lock();
+	//连接已断开时不再放回空闲链表，由后台线程重连，取连接的线程不会拿到坏连接
+	unsigned int err = mysql_errno(con);
+	bool broken = err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
 
-	connList.push_back(con);
-	++FreeConn;
+	lock.lock();
 	--CurConn;
-
+	if (broken)
+	{
+		brokenList.push_back(con);
+		++Pending;
+		maintCond.signal();
+	}
+	else
+	{
+		conn_info &info = connInfo[con];
+		info.used = info.checked = coarse_clock::monotonic_us();
+		connList.push_back(con);
+		++FreeConn;
+		freeCond.signal();       // 唤醒一个等待连接的线程
+	}
 	lock.unlock();
-
-	reserve.post();       // 信号量 唤醒任务
 	return true;
 }
 
-//销毁数据库连接池
-void connection_pool::DestroyPool()
+void *connection_pool::Maintain(void *arg)
 {
+	((connection_pool *)arg)->MaintainLoop();
+	return NULL;
+}
 
+//后台线程：每秒一轮，重连断开的连接，ping 长时间空闲的连接，按等待时间增减连接数
+void connection_pool::MaintainLoop()
+{
+	long long last_stats = coarse_clock::monotonic_us();
+	unsigned long long last_acquires = 0;
+	bool grown = false;
 	lock.lock();
-	if (connList.size() > 0)
+	while (!stopping)
 	{
-		//通过迭代器遍历，关闭数据库连接
-		list<MYSQL *>::iterator it;
-		for (it = connList.begin(); it != connList.end(); ++it)
+		//仍有线程在等待、未到上限且上一轮成功增加了连接时不休眠，每轮增加一条连接；
+		//连接失败时照常等待一秒再试，数据库不可用时不空转刷日志
+		if (!grown || Waiting == 0 || CurConn + FreeConn + Pending >= MaxConn)
+		{
+			struct timespec t;
+			clock_gettime(CLOCK_REALTIME, &t);
+			t.tv_sec += 1;
+			maintCond.timewait(lock.get(), t);
+		}
+		if (stopping)
+			break;
+
+		while (!brokenList.empty() && !stopping)
 		{
-			MYSQL *con = *it;
-			mysql_close(con);
+			MYSQL *con = brokenList.front();
+			brokenList.pop_front();
+			lock.unlock();
+			CloseConn(con);
+			MYSQL *fresh = Connect();
+			lock.lock();
+			--Pending;
+			if (fresh)
+			{
+				++stats.reconnects;
+				AddConn(fresh);
+			}
 		}
-		CurConn = 0;
-		FreeConn = 0;
-		
-		//清空list
-		connList.clear();
 
 		lock.unlock();
+		CheckIdle();
+		grown = Resize();
+		lock.lock();
+
+		long long now = coarse_clock::monotonic_us();
+		if (now - last_stats >= STATS_INTERVAL && stats.acquires != last_acquires)
+		{
+			pool_stats &s = stats;
+			LOG_INFO("mysql pool: conns %u in use %u waiting %u dedicated %u acquires %llu timeouts %llu reconnects %llu wait "
+					 "<0.1ms %llu <1ms %llu <10ms %llu <100ms %llu <1s %llu >=1s %llu",
+					 CurConn + FreeConn + Pending, CurConn, Waiting, Dedicated, s.acquires, s.timeouts, s.reconnects,
+					 s.wait_hist[0], s.wait_hist[1], s.wait_hist[2], s.wait_hist[3], s.wait_hist[4], s.wait_hist[5]);
+			last_stats = now;
+			last_acquires = stats.acquires;
+		}
 	}
+	lock.unlock();
+}
 
+//ping 超过 PING_INTERVAL 没有使用的空闲连接，失败时重连；检查期间这些连接不在空闲链表中
+void connection_pool::CheckIdle()
+{
+	list<MYSQL *> idle;
+	long long now = coarse_clock::monotonic_us();
+	lock.lock();
+	for (list<MYSQL *>::iterator it = connList.begin(); it != connList.end();)
+	{
+		if (now - connInfo[*it].checked >= PING_INTERVAL)
+		{
+			idle.push_back(*it);
+			it = connList.erase(it);
+			--FreeConn;
+			++Pending;
+		}
+		else
+			++it;
+	}
+	lock.unlock();
+
+	for (list<MYSQL *>::iterator it = idle.begin(); it != idle.end(); ++it)
+	{
+		MYSQL *con = *it;
+		bool ok = mysql_ping(con) == 0;
+		if (!ok)
+		{
+			CloseConn(con);
+			con = Connect();
+		}
+		lock.lock();
+		--Pending;
+		if (!ok)
+			++stats.ping_failures;
+		if (con && ok)
+		{
+			connInfo[con].checked = coarse_clock::monotonic_us();
+			connList.push_back(con);
+			++FreeConn;
+			freeCond.signal();
+		}
+		else if (con)
+		{
+			++stats.reconnects;
+			AddConn(con);
+		}
+		lock.unlock();
+	}
+}
+
+//连接数不足 MinConn，或本轮有线程在等待、平均等待超过 GROW_WAIT_US 时增加一条；
+//没有等待且多于 MinConn 时关闭一条空闲超过 IDLE_TIMEOUT 的连接；成功增加了连接时返回 true
+bool connection_pool::Resize()
+{
+	lock.lock();
+	unsigned int total = CurConn + FreeConn + Pending;
+	bool busy = Waiting > 0 || (waitCount > 0 && waitSum / (long long)waitCount > GROW_WAIT_US);
+	waitSum = 0;
+	waitCount = 0;
+	bool grow = total < MaxConn && (total < MinConn || busy);
+	MYSQL *victim = NULL;
+	//归还的连接放在链表尾部，头部是空闲最久的
+	if (!grow && !busy && total > MinConn && !connList.empty())
+	{
+		MYSQL *oldest = connList.front();
+		if (coarse_clock::monotonic_us() - connInfo[oldest].used >= IDLE_TIMEOUT)
+		{
+			victim = oldest;
+			connList.pop_front();
+			--FreeConn;
+		}
+	}
+	if (grow)
+		++Pending;
+	lock.unlock();
+
+	if (victim)
+		CloseConn(victim);
+	if (!grow)
+		return false;
+	MYSQL *con = Connect();
+	lock.lock();
+	--Pending;
+	if (con)
+		AddConn(con);
+	lock.unlock();
+	return con != NULL;
+}
+
+//同一条连接同一时刻只被一个线程持有，它的语句也只被这个线程使用
+MYSQL_STMT *connection_pool::GetStatement(MYSQL *conn, SQL_STMT id)
+{
+	lock.lock();
+	map<MYSQL *, conn_info>::iterator it = connInfo.find(conn);
+	bool found = it != connInfo.end();
+	lock.unlock();
+	if (!found)
+		return NULL;
+	//持有连接期间它不会被重连或关闭，map 节点保持有效
+	MYSQL_STMT *&stmt = it->second.stmts[id];
+	if (stmt)
+		return stmt;
+
+	MYSQL_STMT *s = mysql_stmt_init(conn);
+	string sql = stmt_text(id);
+	if (s && mysql_stmt_prepare(s, sql.c_str(), sql.size()) == 0)
+	{
+		stmt = s;
+		return stmt;
+	}
+	if (s)
+		mysql_stmt_close(s);
+	return NULL;
+}
+
+MYSQL *connection_pool::OpenDedicated()
+{
+	MYSQL *con = Connect();
+	if (con == NULL)
+		return NULL;
+	lock.lock();
+	//登记后 GetStatement 同样可以为它缓存预编译语句
+	conn_info &info = connInfo[con];
+	info.used = info.checked = coarse_clock::monotonic_us();
+	info.stmts.assign(STMT_COUNT, (MYSQL_STMT *)NULL);
+	++Dedicated;
+	lock.unlock();
+	return con;
+}
+
+void connection_pool::CloseDedicated(MYSQL *con)
+{
+	CloseConn(con);
+	lock.lock();
+	--Dedicated;
+	lock.unlock();
+}
+
+void connection_pool::GetStats(pool_stats *st)
+{
+	lock.lock();
+	*st = stats;
+	st->total = CurConn + FreeConn + Pending;
+	st->in_use = CurConn;
+	st->waiting = Waiting;
+	st->dedicated = Dedicated;
+	lock.unlock();
+}
+
+//销毁数据库连接池
+void connection_pool::DestroyPool()
+{
+	lock.lock();
+	stopping = true;
+	maintCond.signal();
+	freeCond.broadcast();
+	lock.unlock();
+	if (maintStarted)
+	{
+		pthread_join(maintTid, NULL);
+		maintStarted = false;
+	}
+
+	//关闭空闲和等待重连的数据库连接；仍被取出的连接由持有者归还
+	lock.lock();
+	list<MYSQL *> conns;
+	conns.splice(conns.end(), connList);
+	conns.splice(conns.end(), brokenList);
+	FreeConn = 0;
 	lock.unlock();
+	for (list<MYSQL *>::iterator it = conns.begin(); it != conns.end(); ++it)
+		CloseConn(*it);
 }
 
 //当前空闲的连接数
 int connection_pool::GetFreeConn()
 {
-	return this->FreeConn;
+	lock.lock();
+	int n = this->FreeConn;
+	lock.unlock();
+	return n;
 }
 
 connection_pool::~connection_pool()
@@ -146,13 +479,55 @@ connection_pool::~connection_pool()
 
 //通过有参构造对传入的参数进行修改。其中数据库连接本身是指针类型，所以参数需要通过双指针才能对其进行修改。
 /* 资源在对象构造初始化 在对象析构时释放*/
+//connPool 为 NULL(不使用 MySQL 的存储后端)时不取连接
 connectionRAII::connectionRAII(MYSQL **SQL, connection_pool *connPool){     //构造函数
-	*SQL = connPool->GetConnection();
-	
+	*SQL = connPool ? connPool->GetConnection() : NULL;
+
 	conRAII = *SQL;
 	poolRAII = connPool;
 }
 
 connectionRAII::~connectionRAII(){         // 析构函数
-	poolRAII->ReleaseConnection(conRAII);
-}
\ No newline at end of file
+	if (poolRAII)
+		poolRAII->ReleaseConnection(conRAII);
+}
+
+threadConnection::threadConnection(connection_pool *connPool){
+	conTC = NULL;
+	poolTC = connPool;
+	usedTC = 0;
+	retryTC = 0;
+}
+
+threadConnection::~threadConnection(){
+	if (conTC)
+		poolTC->CloseDedicated(conTC);
+}
+
+MYSQL *threadConnection::Get(){
+	if (!poolTC)
+		return NULL;
+	time_t now = coarse_clock::monotonic_sec();
+	if (conTC)
+	{
+		unsigned int err = mysql_errno(conTC);
+		bool broken = err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
+		if (!broken && (now - usedTC) * 1000000LL >= PING_INTERVAL)
+			broken = mysql_ping(conTC) != 0;
+		if (!broken)
+			return conTC;
+		poolTC->CloseDedicated(conTC);
+		conTC = NULL;
+	}
+	if (now < retryTC)
+		return NULL;
+	conTC = poolTC->OpenDedicated();
+	if (!conTC)
+		retryTC = now + 1;
+	usedTC = now;
+	return conTC;
+}
+
+void threadConnection::Release(){
+	usedTC = coarse_clock::monotonic_sec();
+}
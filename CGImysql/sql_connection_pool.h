@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <list>
+#include <map>
+#include <vector>
 #include <mysql/mysql.h>
 #include <error.h>
 #include <string.h>
@@ -12,35 +14,108 @@
 
 using namespace std;
 
+//预编译语句的编号，SQL 文本由 sql_connection_pool.cpp 中的 stmt_text 生成
+enum SQL_STMT
+{
+	STMT_INSERT_USER = 0,   //INSERT INTO user(username, passwd) VALUES(?, ?)
+	//INSERT IGNORE 一次插入 2^k 行，批量写回注册时按二进制位拆分行数
+	STMT_INSERT_USERS_1,
+	STMT_INSERT_USERS_2,
+	STMT_INSERT_USERS_4,
+	STMT_INSERT_USERS_8,
+	STMT_INSERT_USERS_16,
+	STMT_INSERT_USERS_32,
+	STMT_INSERT_USERS_64,
+	STMT_COUNT
+};
+
+//连接池的统计，GetStats 返回调用时的快照
+struct pool_stats
+{
+	static const int WAIT_BUCKETS = 6;
+	unsigned int total;			//当前连接数
+	unsigned int in_use;		//被取出的连接数
+	unsigned int waiting;		//正在等待的线程数
+	unsigned int dedicated;		//工作线程独占的连接数，不计入 total
+	unsigned long long acquires;
+	unsigned long long timeouts;
+	unsigned long long reconnects;
+	unsigned long long ping_failures;
+	//获取连接的等待时间分布：<0.1ms <1ms <10ms <100ms <1s >=1s
+	unsigned long long wait_hist[WAIT_BUCKETS];
+};
+
 class connection_pool
 {
 public:
-	MYSQL *GetConnection();				 //获取数据库连接
-	bool ReleaseConnection(MYSQL *conn); //释放连接
+	MYSQL *GetConnection();				 //获取数据库连接，最多等待 init 时给出的超时
+	MYSQL *GetConnection(int timeout_ms); //超时返回 NULL，timeout_ms < 0 时一直等待
+	bool ReleaseConnection(MYSQL *conn); //释放连接，连接已断开时交给后台线程重连
 	int GetFreeConn();					 //获取连接
+	int GetMaxConn() { return MaxConn; }
+	void GetStats(pool_stats *st);
 	void DestroyPool();					 //销毁所有连接
+	//取 conn 上预编译好的语句，第一次使用时才 prepare；只能由持有该连接的线程调用
+	MYSQL_STMT *GetStatement(MYSQL *conn, SQL_STMT id);
+	//建立和关闭不经过空闲链表、不计入 MaxConn 的独占连接，由 threadConnection 使用
+	MYSQL *OpenDedicated();
+	void CloseDedicated(MYSQL *conn);
 
-	//使用局部静态变量懒汉模式创建连接池。
+	//使用局部静态变量懒汉模式创建连接池；需要多个池(如读写分离)时直接构造
 	static connection_pool *GetInstance();
 
-	void init(string url, string User, string PassWord, string DataBaseName, int Port, unsigned int MaxConn); 
+	//先建立 MinConn 条连接(0 表示 MaxConn 条)，等待连接的时间持续偏长时逐步增加到 MaxConn
+	//一条连接都建立不了时返回 false，后台线程会继续重试
+	bool init(string url, string User, string PassWord, string DataBaseName, int Port, unsigned int MaxConn,
+			  unsigned int MinConn = 0, int timeout_ms = 3000);
 	
 	connection_pool();
 	~connection_pool();
 
+private:
+	MYSQL *Connect();
+	void CloseConn(MYSQL *conn);
+	void AddConn(MYSQL *conn);
+	static void *Maintain(void *arg);
+	void MaintainLoop();
+	void CheckIdle();
+	bool Resize();
+	void AddWait(long long us);
+
 private:
 	unsigned int MaxConn;  //最大连接数
+	unsigned int MinConn;  //最少保持的连接数
 	unsigned int CurConn;  //当前已使用的连接数
 	unsigned int FreeConn; //当前空闲的连接数
+	unsigned int Pending;  //后台线程正在检查或重连、暂不在 connList 中的连接数
+	unsigned int Dedicated; //工作线程独占的连接数
+	int Timeout;		   //GetConnection() 的默认等待时间(毫秒)
 
 private:
 	locker lock;
-	list<MYSQL *> connList;   //连接池
-	sem reserve; // 信号量
+	list<MYSQL *> connList;   //连接池，空闲连接
+	cond freeCond;			  //有连接归还时唤醒等待者
+	cond maintCond;			  //唤醒后台线程
+	unsigned int Waiting;
+	list<MYSQL *> brokenList; //已断开、等待重连的连接
+	struct conn_info
+	{
+		long long used;				//上次归还的时间(微秒)
+		long long checked;			//上次确认可用的时间(微秒)
+		vector<MYSQL_STMT *> stmts; //预编译语句，持有连接期间不会被关闭
+	};
+	//重连和增删连接时修改，查找也需要加锁
+	map<MYSQL *, conn_info> connInfo;
+	pool_stats stats;
+	long long waitSum;		  //本轮维护周期内的等待时间和次数，用于决定是否扩容
+	unsigned long long waitCount;
+	pthread_t maintTid;
+	bool maintStarted;
+	bool stopping;
 
 private:
 	string url;			 //主机地址
-	string Port;		 //数据库端口号
+	int Port;			 //数据库端口号
 	string User;		 //登陆数据库用户名
 	string PassWord;	 //登陆数据库密码
 	string DatabaseName; //使用数据库名
@@ -57,4 +132,21 @@ private:
 	connection_pool *poolRAII;
 };
 
+//工作线程独占的连接：第一次使用时建立，之后取用不经过连接池的锁和空闲链表
+//空闲超过 30 秒先 ping，上次使用时已断开则重连；建立失败时 Get 返回 NULL，调用方改用连接池，1 秒后再重试
+//只能由创建它的线程使用
+class threadConnection{
+public:
+	threadConnection(connection_pool *connPool);	//connPool 为 NULL 时 Get 总是返回 NULL
+	~threadConnection();
+	MYSQL *Get();
+	void Release();
+
+private:
+	MYSQL *conTC;
+	connection_pool *poolTC;
+	time_t usedTC;		//上次使用的时间(秒级单调时间，每次取用不读精确时钟)
+	time_t retryTC;		//建立失败后下次重试的时间
+};
+
 #endif
@@ -0,0 +1,61 @@
+#ifndef CO_SQL_H
+#define CO_SQL_H
+
+#include <coroutine>
+#include <mysql/mysql.h>
+
+class sql_awaiter;
+
+// 在数据库线程上执行的函数；ctx 由发起者提供，挂起期间须保持有效(如放在协程帧中)
+typedef int (*sql_fn)(MYSQL *conn, void *ctx);
+
+// 数据库任务的调度接口，由线程池实现：在专用的数据库线程上执行任务，完成后把协程交回工作线程恢复
+class sql_scheduler
+{
+public:
+    virtual ~sql_scheduler() {}
+    virtual bool submit(sql_awaiter *job) = 0;
+};
+
+// co_await sql_awaiter(...) 挂起当前请求，数据库往返期间不占用工作线程
+// 未开启协程模式(sched 为 NULL)时，直接在当前线程用 conn 同步执行，不发生挂起
+class sql_awaiter
+{
+public:
+    sql_awaiter(sql_scheduler *sched, void *owner, MYSQL *conn, sql_fn fn, void *ctx)
+        : m_sched(sched), m_owner(owner), m_conn(conn), m_fn(fn), m_ctx(ctx), m_result(-1) {}
+
+    bool await_ready()
+    {
+        if (m_sched)
+            return false;
+        m_result = m_fn(m_conn, m_ctx);
+        return true;
+    }
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        m_handle = h;
+        //提交成功后本对象可能已在别的线程被恢复并销毁，之后不能再访问成员
+        if (m_sched->submit(this))
+            return true;
+        m_result = -1;
+        return false;
+    }
+    int await_resume() { return m_result; }
+
+    //由数据库线程调用
+    void run(MYSQL *conn) { m_result = m_fn(conn, m_ctx); }
+    void *owner() { return m_owner; }
+    std::coroutine_handle<> handle() { return m_handle; }
+
+private:
+    sql_scheduler *m_sched;
+    void *m_owner;                      // 发起请求的任务对象(http_conn)
+    MYSQL *m_conn;
+    sql_fn m_fn;                        // 函数指针加上下文，不经过 std::function，不分配内存
+    void *m_ctx;
+    int m_result;
+    std::coroutine_handle<> m_handle;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef CO_TASK_H
+#define CO_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <stdlib.h>
+
+// 协程帧分配器：按 64 字节分档的线程局部空闲链表，请求处理路径上的协程帧不走 malloc
+class co_frame_alloc
+{
+public:
+    static void *alloc(size_t size)
+    {
+        size_t idx = (size + 63) / 64;
+        if (idx < MAX_CLASS && t_free[idx])
+        {
+            node *n = t_free[idx];
+            t_free[idx] = n->next;
+            return n;
+        }
+        void *p = malloc(idx < MAX_CLASS ? idx * 64 : size);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+    //帧可能在别的线程上被销毁，归还到当前线程的链表即可
+    static void free(void *p, size_t size)
+    {
+        size_t idx = (size + 63) / 64;
+        if (idx < MAX_CLASS)
+        {
+            node *n = (node *)p;
+            n->next = t_free[idx];
+            t_free[idx] = n;
+            return;
+        }
+        ::free(p);
+    }
+
+private:
+    struct node
+    {
+        node *next;
+    };
+    static const size_t MAX_CLASS = 32;
+    static inline thread_local node *t_free[MAX_CLASS] = {};
+};
+
+struct co_promise_base
+{
+    static void *operator new(size_t size) { return co_frame_alloc::alloc(size); }
+    static void operator delete(void *p, size_t size) { co_frame_alloc::free(p, size); }
+    void unhandled_exception() { std::terminate(); }
+};
+
+// 惰性协程：被 co_await 时才开始执行，结束时通过对称转移恢复等待者
+template <typename T>
+class co_task
+{
+public:
+    struct promise_type : co_promise_base
+    {
+        T m_value;
+        std::coroutine_handle<> m_continuation;
+
+        co_task get_return_object() { return co_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+            {
+                return h.promise().m_continuation;
+            }
+            void await_resume() noexcept {}
+        };
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_value(T value) { m_value = value; }
+    };
+
+    explicit co_task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+    co_task(co_task &&other) : m_handle(other.m_handle) { other.m_handle = nullptr; }
+    co_task(const co_task &) = delete;
+    ~co_task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        m_handle.promise().m_continuation = caller;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().m_value; }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// 即发即弃的顶层协程：创建后立即执行到第一个挂起点，结束时自动销毁帧
+struct co_detached
+{
+    struct promise_type : co_promise_base
+    {
+        co_detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+    };
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include <string.h>
+#include <sys/mman.h>
+#include "file_cache.h"
+#include "../timer/coarse_clock.h"
+
+file_blob::~file_blob()
+{
+    if (locked)
+        munlock(addr, map_len);
+    munmap(addr, map_len);
+}
+
+//取出或新建条目，调用者持有写锁
+file_meta &file_cache::entry(std::string_view path)
+{
+    file_map::iterator it = m_files.find(path);
+    if (it != m_files.end())
+        return it->second;
+    if (m_files.size() >= MAX_ENTRIES)
+    {
+        for (it = m_files.begin(); it != m_files.end();)
+            it = it->second.blob ? std::next(it) : m_files.erase(it);
+    }
+    file_meta &m = m_files.emplace(std::string(path), file_meta()).first->second;
+    m.mime = NULL;
+    return m;
+}
+
+bool file_cache::lookup(const char *path, file_meta *meta)
+{
+    std::string_view key(path);
+    time_t now = coarse_clock::monotonic_sec();
+
+    m_lock.rdlock();
+    file_map::iterator it = m_files.find(key);
+    bool hit = it != m_files.end() && now - it->second.checked < VALID_SEC;
+    if (hit)
+        *meta = it->second;
+    m_lock.unlock();
+    if (hit)
+        return true;
+
+    struct stat st;
+    if (stat(path, &st) < 0)
+    {
+        //文件被删除后不再保留旧条目
+        m_lock.wrlock();
+        it = m_files.find(key);
+        if (it != m_files.end())
+            m_files.erase(it);
+        m_lock.unlock();
+        return false;
+    }
+
+    m_lock.wrlock();
+    file_meta &m = entry(key);
+    //文件没有变化时沿用类型和格式化好的日期；变化后预热的内容已过时
+    if (!m.mime || m.st.st_size != st.st_size || m.st.st_mtime != st.st_mtime || m.st.st_ino != st.st_ino)
+    {
+        m.mime = mime_lookup(path);
+        format_http_date(m.last_modified, st.st_mtime);
+        m.blob.reset();
+    }
+    m.st = st;
+    m.checked = now;
+    *meta = m;
+    m_lock.unlock();
+    return true;
+}
+
+void file_cache::add_preloaded(const char *path, const struct stat &st, const std::shared_ptr<file_blob> &blob)
+{
+    m_lock.wrlock();
+    file_meta &m = entry(path);
+    m.st = st;
+    m.mime = mime_lookup(path);
+    format_http_date(m.last_modified, st.st_mtime);
+    m.checked = coarse_clock::monotonic_sec();
+    m.blob = blob;
+    m_lock.unlock();
+}
+
+size_t file_cache::size()
+{
+    m_lock.rdlock();
+    size_t n = m_files.size();
+    m_lock.unlock();
+    return n;
+}
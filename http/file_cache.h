@@ -0,0 +1,76 @@
+/*************************************************************
+*静态文件元数据缓存：路径 -> stat 结果、MIME 类型与策略、格式化好的 Last-Modified
+*同一文件 VALID_SEC 秒内的请求不再 stat；过期后重新 stat，大小或修改时间变了才重新查类型、格式化日期
+*不缓存不存在的文件，条目超过 MAX_ENTRIES 时清空(预热的文件除外)
+*预热的文件(见 file_preload)带有常驻内存的内容，文件变化后不再使用，旧内容在最后一个发送它的连接结束后释放
+**************************************************************/
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <time.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "mime_types.h"
+#include "response_writer.h"
+#include "../lock/locker.h"
+
+//预热进内存的文件内容
+struct file_blob
+{
+    char *addr;
+    size_t len;                 //文件长度
+    size_t map_len;             //映射长度，大页时向上取整到 2MB
+    bool locked;                //已 mlock
+    bool huge;                  //匿名大页内存中的副本
+    ~file_blob();
+};
+
+struct file_meta
+{
+    struct stat st;
+    const mime_type *mime;
+    char last_modified[HTTP_DATE_LEN + 1];
+    time_t checked;             //上次 stat 的时间(单调时钟，秒)
+    std::shared_ptr<file_blob> blob;    //非空时直接发送其中的内容，不再 open/mmap
+};
+
+class file_cache
+{
+public:
+    static const int VALID_SEC = 1;
+    static const size_t MAX_ENTRIES = 4096;
+
+    static file_cache *get_instance()
+    {
+        static file_cache instance;
+        return &instance;
+    }
+
+    //元数据复制到 meta；stat 失败时返回 false，errno 保留
+    bool lookup(const char *path, file_meta *meta);
+    //登记预热好的文件，st 为载入内容前的 stat 结果
+    void add_preloaded(const char *path, const struct stat &st, const std::shared_ptr<file_blob> &blob);
+    size_t size();
+
+private:
+    file_cache() {}
+    file_meta &entry(std::string_view path);
+
+    //按 string_view 查找，不为每次查找构造 std::string
+    struct path_hash
+    {
+        typedef void is_transparent;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+    };
+    typedef std::unordered_map<std::string, file_meta, path_hash, std::equal_to<> > file_map;
+
+private:
+    rwlocker m_lock;
+    file_map m_files;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include "file_preload.h"
+#include "mime_types.h"
+#include "../log/log.h"
+#include "../timer/coarse_clock.h"
+
+static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+struct preload_candidate
+{
+    std::string path;
+    off_t size;
+    int rank;               //越小越先预热
+};
+
+//nftw 的回调没有用户参数，只有预热线程使用
+static std::vector<preload_candidate> *found_files;
+
+static int rank_of(const mime_type *m)
+{
+    if (m->sendfile)
+        return 2;
+    return m->cache == CACHE_LONG ? 1 : 0;
+}
+
+static int collect(const char *path, const struct stat *st, int type, struct FTW *)
+{
+    if (type == FTW_F && S_ISREG(st->st_mode) && (st->st_mode & S_IROTH) && st->st_size > 0)
+        found_files->push_back({path, st->st_size, rank_of(mime_lookup(path))});
+    return 0;
+}
+
+static bool read_all(int fd, char *buf, size_t len)
+{
+    for (size_t off = 0; off < len;)
+    {
+        ssize_t n = pread(fd, buf + off, len - off, off);
+        if (n <= 0)
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+//按 2MB 对齐的匿名内存，透明大页只作用于对齐的区间
+static char *alloc_huge(size_t map_len)
+{
+    char *p = (char *)mmap(NULL, map_len + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    char *start = (char *)(((uintptr_t)p + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+    if (start > p)
+        munmap(p, start - p);
+    munmap(start + map_len, p + HUGE_PAGE - start);
+    madvise(start, map_len, MADV_HUGEPAGE);
+    return start;
+}
+
+file_preload::file_preload()
+{
+    m_budget = 0;
+    m_lock = false;
+    m_huge = false;
+    m_stop = false;
+    m_started = false;
+    m_elapsed_ms = -1;
+}
+
+bool file_preload::start(const char *root, long long budget, bool lock, bool huge)
+{
+    m_root = root;
+    m_budget = budget;
+    m_lock = lock;
+    m_huge = huge;
+    if (pthread_create(&m_tid, NULL, worker, this) != 0)
+        return false;
+    m_started = true;
+    return true;
+}
+
+void file_preload::stop()
+{
+    if (!m_started)
+        return;
+    __atomic_store_n(&m_stop, true, __ATOMIC_RELAXED);
+    pthread_join(m_tid, NULL);
+    m_started = false;
+}
+
+void *file_preload::worker(void *arg)
+{
+    ((file_preload *)arg)->run();
+    return NULL;
+}
+
+std::shared_ptr<file_blob> file_preload::load(const std::string &path, struct stat *st)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    std::shared_ptr<file_blob> blob;
+    if (fstat(fd, st) == 0 && st->st_size > 0)
+    {
+        size_t len = st->st_size;
+        bool huge = m_huge && len >= HUGE_PAGE;
+        size_t map_len = huge ? (len + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1) : len;
+        char *p = NULL;
+        if (huge)
+        {
+            p = alloc_huge(map_len);
+            if (p && !read_all(fd, p, len))
+            {
+                munmap(p, map_len);
+                p = NULL;
+            }
+            if (p)
+                mprotect(p, map_len, PROT_READ);
+        }
+        else
+        {
+            p = (char *)mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            if (p == MAP_FAILED)
+                p = NULL;
+            else
+                madvise(p, len, MADV_WILLNEED);
+        }
+        if (p)
+        {
+            blob.reset(new file_blob{p, len, map_len, false, huge});
+            if (m_lock)
+                blob->locked = mlock(p, map_len) == 0;
+        }
+
+        //载入期间文件被改写时放弃，之后的请求按普通方式读取
+        struct stat after;
+        if (blob && (fstat(fd, &after) != 0 || after.st_size != st->st_size || after.st_mtime != st->st_mtime))
+            blob.reset();
+    }
+    close(fd);
+    return blob;
+}
+
+void file_preload::run()
+{
+    long long start = coarse_clock::monotonic_us();
+    std::vector<preload_candidate> files;
+    found_files = &files;
+    if (nftw(m_root.c_str(), collect, 16, 0) != 0)
+        LOG_WARN("walk %s failed, preloading what was found", m_root.c_str());
+    std::sort(files.begin(), files.end(), [](const preload_candidate &a, const preload_candidate &b) {
+        return a.rank != b.rank ? a.rank < b.rank : a.size < b.size;
+    });
+
+    long long used = 0;
+    size_t lock_failed = 0;
+    for (size_t i = 0; i < files.size() && !__atomic_load_n(&m_stop, __ATOMIC_RELAXED); ++i)
+    {
+        if (used + files[i].size > m_budget)
+            continue;
+        struct stat st;
+        std::shared_ptr<file_blob> blob = load(files[i].path, &st);
+        if (!blob)
+            continue;
+        if (m_lock && !blob->locked)
+            ++lock_failed;
+        used += blob->len;
+        file_cache::get_instance()->add_preloaded(files[i].path.c_str(), st, blob);
+        m_mutex.lock();
+        m_blobs.push_back(blob);
+        m_mutex.unlock();
+    }
+    if (lock_failed)
+        LOG_WARN("mlock failed for %zu preloaded files, check RLIMIT_MEMLOCK", lock_failed);
+
+    m_mutex.lock();
+    m_elapsed_ms = (coarse_clock::monotonic_us() - start) / 1000;
+    m_mutex.unlock();
+    preload_stats s;
+    stats(&s);
+    LOG_INFO("preloaded %zu of %zu files, %zu KB (resident %zu KB, locked %zu KB, huge pages %zu KB) in %lld ms",
+             s.files, files.size(), s.bytes / 1024, s.resident / 1024, s.locked / 1024, s.huge / 1024, s.elapsed_ms);
+}
+
+void file_preload::stats(preload_stats *st)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> vec;
+    st->files = st->bytes = st->resident = st->locked = st->huge = 0;
+
+    m_mutex.lock();
+    st->elapsed_ms = m_elapsed_ms;
+    for (size_t i = 0; i < m_blobs.size(); ++i)
+    {
+        std::shared_ptr<file_blob> b = m_blobs[i].lock();
+        if (!b)
+            continue;
+        ++st->files;
+        st->bytes += b->len;
+        if (b->locked)
+            st->locked += b->len;
+        if (b->huge)
+            st->huge += b->len;
+        //只统计文件内容所在的页，大页的对齐部分不计
+        size_t pages = (b->len + page - 1) / page;
+        vec.resize(pages);
+        if (mincore(b->addr, pages * page, &vec[0]) != 0)
+            continue;
+        size_t resident = 0;
+        for (size_t j = 0; j < pages; ++j)
+            resident += vec[j] & 1;
+        st->resident += std::min(resident * page, b->len);
+    }
+    m_mutex.unlock();
+}
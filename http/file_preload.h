@@ -0,0 +1,67 @@
+/*************************************************************
+*静态文件预热：启动后由后台线程遍历网站目录，把最常用的文件载入内存并登记到 file_cache，
+*之后的请求直接发送内存中的内容，第一次访问不再在 writev 中产生缺页
+*无法预知访问频率，按类型排优先级：页面、样式和脚本，其次图片和字体，最后音视频等大文件；同一类中小文件优先，
+*总量不超过 budget 字节
+*  普通方式：MAP_POPULATE 映射文件并 MADV_WILLNEED，内容在页缓存中
+*  lock：再 mlock，不会被换出或回收
+*  huge：不小于 2MB 的文件复制到匿名内存并 MADV_HUGEPAGE，减少 TLB 缺失；小文件仍用普通方式
+**************************************************************/
+
+#ifndef FILE_PRELOAD_H
+#define FILE_PRELOAD_H
+
+#include <pthread.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "file_cache.h"
+#include "../lock/locker.h"
+
+struct preload_stats
+{
+    size_t files;
+    size_t bytes;               //预热的文件总长度
+    size_t resident;            //仍在内存中的字节数(mincore)
+    size_t locked;              //mlock 的字节数
+    size_t huge;                //放在大页中的字节数
+    long long elapsed_ms;       //预热耗时，未完成时为 -1
+};
+
+class file_preload
+{
+public:
+    static file_preload *get_instance()
+    {
+        static file_preload instance;
+        return &instance;
+    }
+
+    //启动后台预热线程；budget 为字节数
+    bool start(const char *root, long long budget, bool lock, bool huge);
+    //停止并等待预热线程退出
+    void stop();
+    void stats(preload_stats *st);
+
+private:
+    file_preload();
+    static void *worker(void *arg);
+    void run();
+    std::shared_ptr<file_blob> load(const std::string &path, struct stat *st);
+
+private:
+    std::string m_root;
+    long long m_budget;
+    bool m_lock;
+    bool m_huge;
+    bool m_stop;
+    bool m_started;
+    pthread_t m_tid;
+    long long m_elapsed_ms;
+
+    locker m_mutex;
+    //预热过的内容；文件更新后 file_cache 不再引用旧内容，这里也不延长其生命周期
+    std::vector<std::weak_ptr<file_blob> > m_blobs;
+};
+
+#endif
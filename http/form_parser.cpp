@@ -0,0 +1,166 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "form_parser.h"
+
+//字段名的最大长度
+static const size_t MAX_NAME = 64;
+
+//返回 [p, end) 中第一个 '%' 或 '+' 的位置，没有时返回 end
+static const char *find_special(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    const __m128i pct = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, pct), _mm_cmpeq_epi8(v, plus)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p < end; ++p)
+        if (*p == '%' || *p == '+')
+            return p;
+    return end;
+}
+
+//返回 [p, end) 中第一个 '&'、'='、'%' 或 '+' 的位置，没有时返回 end
+static char *find_delim(char *p, const char *end)
+{
+#ifdef __SSE2__
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i pct = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, eq)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, pct), _mm_cmpeq_epi8(v, plus)));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p < end; ++p)
+        if (*p == '&' || *p == '=' || *p == '%' || *p == '+')
+            return p;
+    return (char *)end;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+size_t url_decode(char *buf, size_t len)
+{
+    const char *end = buf + len;
+    const char *src = find_special(buf, end);
+    char *dst = (char *)src;
+    while (src < end)
+    {
+        int hi, lo;
+        if (*src == '+')
+        {
+            *dst++ = ' ';
+            ++src;
+        }
+        else if (end - src >= 3 && (hi = hex_value(src[1])) >= 0 && (lo = hex_value(src[2])) >= 0)
+        {
+            *dst++ = (char)(hi << 4 | lo);
+            src += 3;
+        }
+        else
+            *dst++ = *src++;
+        //连续的 %XX(如 UTF-8 字符)不必再扫描；两个需要解码的字符之间的部分整段前移
+        if (src < end && (*src == '%' || *src == '+'))
+            continue;
+        const char *next = find_special(src, end);
+        memmove(dst, src, next - src);
+        dst += next - src;
+        src = next;
+    }
+    return dst - buf;
+}
+
+bool form_parser::parse(char *body, size_t len)
+{
+    m_count = 0;
+    char *end = body + len;
+    char *start = body;     //当前字段的开头
+    char *eq = NULL;        //当前字段中第一个 '='
+    bool coded = false;     //当前字段含有 '%' 或 '+'
+    //整个消息体只扫描一遍，没有需要解码的字段不再回头
+    for (char *p = body;; ++p)
+    {
+        if (coded && eq)
+        {
+            //已经确定要解码，剩下只需找字段结尾
+            p = (char *)memchr(p, '&', end - p);
+            if (!p)
+                p = end;
+        }
+        else
+            p = find_delim(p, end);
+        if (p < end && *p != '&')
+        {
+            if (*p != '=')
+                coded = true;
+            else if (!eq)
+                eq = p;
+            continue;
+        }
+        //跳过空字段，如 "a=1&&b=2"
+        if (p > start && !add_field(start, eq ? eq : p, eq ? eq + 1 : p, p, coded))
+            return false;
+        if (p == end)
+            return true;
+        start = p + 1;
+        eq = NULL;
+        coded = false;
+    }
+}
+
+bool form_parser::add_field(char *name, char *name_end, char *value, char *value_end, bool coded)
+{
+    if (m_count == MAX_FIELDS || (size_t)(name_end - name) > MAX_NAME || (size_t)(value_end - value) > m_max_value)
+        return false;
+    size_t name_len = name_end - name;
+    size_t value_len = value_end - value;
+    if (coded)
+    {
+        name_len = url_decode(name, name_len);
+        value_len = url_decode(value, value_len);
+        //%00 解码出的 '\0' 会让按 C 字符串使用的调用方看到截断后的值
+        if (memchr(name, '\0', name_len) || memchr(value, '\0', value_len))
+            return false;
+    }
+    //解码后不长于原文，结尾的 '\0' 最多覆盖 '=' 或 '&'，它们已经切分过了
+    name[name_len] = '\0';
+    value[value_len] = '\0';
+
+    field &f = m_fields[m_count++];
+    f.name = name;
+    f.name_len = name_len;
+    f.value = value;
+    f.value_len = value_len;
+    return true;
+}
+
+std::string_view form_parser::get(std::string_view name) const
+{
+    for (int i = 0; i < m_count; ++i)
+        if (std::string_view(m_fields[i].name, m_fields[i].name_len) == name)
+            return std::string_view(m_fields[i].value, m_fields[i].value_len);
+    return std::string_view();
+}
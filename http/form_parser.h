@@ -0,0 +1,48 @@
+/*************************************************************
+*application/x-www-form-urlencoded 消息体解析，不拷贝：
+*字段按 '&' 和 '=' 切分，名字和值在原缓冲中就地 URL 解码('+' 为空格，%XX 为一个字节)，
+*解码结果不长于原文，写完后以 '\0' 结尾，返回的 string_view 直接指向消息体
+*字段顺序任意；字段数、名字和值的长度超过上限时 parse 返回 false
+*消息体只扫描一遍，查找分隔符和 '%'、'+' 时每次比较 16 字节(SSE2)；没有需要解码的字段只写结尾的 '\0'
+**************************************************************/
+
+#ifndef FORM_PARSER_H
+#define FORM_PARSER_H
+
+#include <stddef.h>
+#include <string_view>
+
+//就地解码 buf 的前 len 字节，返回解码后的长度；非法的 % 序列原样保留
+size_t url_decode(char *buf, size_t len);
+
+class form_parser
+{
+public:
+    static const int MAX_FIELDS = 16;
+
+    //max_value 为解码前值的最大长度
+    form_parser(size_t max_value = 255) : m_count(0), m_max_value(max_value) {}
+
+    //body 中的内容会被改写；body[len] 必须可写(通常是消息体结尾的 '\0')
+    bool parse(char *body, size_t len);
+    //找不到时返回空的 string_view(data() 为 NULL)
+    std::string_view get(std::string_view name) const;
+    int size() const { return m_count; }
+
+private:
+    bool add_field(char *name, char *name_end, char *value, char *value_end, bool coded);
+
+    //不用 string_view 成员：构造时不必清零整个数组
+    struct field
+    {
+        const char *name;
+        const char *value;
+        unsigned int name_len;
+        unsigned int value_len;
+    };
+    field m_fields[MAX_FIELDS];
+    int m_count;
+    size_t m_max_value;
+};
+
+#endif
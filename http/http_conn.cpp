@@ -2,9 +2,17 @@
 
 #include "http_conn.h"
 #include "../log/log.h"
-#include <map>
+#include "../log/access_log.h"
+#include "../timer/coarse_clock.h"
+#include "../user/user_store.h"
+#include "../user/user_backend.h"
+#include "../session/session_store.h"
+#include "form_parser.h"
+#include "route_table.h"
 #include <mysql/mysql.h>
 #include <fstream>
+#include <algorithm>
+#include <limits.h>
 
 //#define connfdET //边缘触发非阻塞
 #define connfdLT //水平触发阻塞
@@ -14,6 +22,8 @@
 
 //定义http响应的一些状态信息
 const char *ok_200_title = "OK";
+const char *redirect_302_title = "Found";
+const char *not_modified_304_title = "Not Modified";
 const char *error_400_title = "Bad Request";
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
 const char *error_403_title = "Forbidden";
@@ -23,45 +33,28 @@ const char *error_404_form = "The requested file was not found on this server.\n
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
+//路由表：新增页面或接口只需在这里加一行，表单的 action 与这里的路径对应
+static constexpr route routes[] = {
+    {"/", ROUTE_EXACT, ROUTE_ANY, ROUTE_PAGE, "/judge.html", NULL},
+    {"/0", ROUTE_EXACT, ROUTE_ANY, ROUTE_PAGE, "/register.html", NULL},
+    {"/1", ROUTE_EXACT, ROUTE_ANY, ROUTE_PAGE, "/log.html", "/welcome.html"},
+    {"/2CGISQL.cgi", ROUTE_EXACT, ROUTE_POST, ROUTE_LOGIN, NULL, "/welcome.html"},
+    {"/3CGISQL.cgi", ROUTE_EXACT, ROUTE_POST, ROUTE_REGISTER, NULL, NULL},
+    {"/5", ROUTE_EXACT, ROUTE_ANY, ROUTE_PAGE, "/picture.html", NULL},
+    {"/6", ROUTE_EXACT, ROUTE_ANY, ROUTE_PAGE, "/video.html", NULL},
+    {"/7", ROUTE_EXACT, ROUTE_ANY, ROUTE_PAGE, "/fans.html", NULL},
+    {"/login", ROUTE_EXACT, ROUTE_GET, ROUTE_REDIRECT, "/1", NULL},
+    {"/register", ROUTE_EXACT, ROUTE_GET, ROUTE_REDIRECT, "/0", NULL},
+};
+static constexpr route_table route_map(routes);
+
+//与 METHOD 枚举的顺序一致
+static const char *method_name[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"};
+
 //  当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
 //  网站根目录，文件夹内存放请求的资源和跳转的html文件
 const char *doc_root = "/home/TinyWebServer-raw_version/root";
 
-//将表中的用户名和密码放入map
-map<string, string> users;
-locker m_lock;
-
-// 载入数据库表
-void http_conn::initmysql_result(connection_pool *connPool)
-{
-    //先从连接池中取一个连接
-    MYSQL *mysql = NULL;
-    connectionRAII mysqlcon(&mysql, connPool);
-
-    //在user表中检索username，passwd数据，浏览器端输入
-    if (mysql_query(mysql, "SELECT username,passwd FROM user"))
-    {
-        LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
-    }
-
-    //从表中检索完整的结果集
-    MYSQL_RES *result = mysql_store_result(mysql);
-
-    //返回结果集中的列数
-    int num_fields = mysql_num_fields(result);
-
-    //返回所有字段结构的数组
-    MYSQL_FIELD *fields = mysql_fetch_fields(result);
-
-    //从结果集中获取下一行，将对应的用户名和密码，存入map中
-    while (MYSQL_ROW row = mysql_fetch_row(result))
-    {
-        string temp1(row[0]);
-        string temp2(row[1]);
-        users[temp1] = temp2;
-    }
-}
-
 //对文件描述符设置非阻塞
 int setnonblocking(int fd)
 {
@@ -125,23 +118,71 @@ void modfd(int epollfd, int fd, int ev)
 
 int http_conn::m_user_count = 0;
 int http_conn::m_epollfd = -1;
-
-//关闭连接，关闭一个连接，客户总量减一
+sql_scheduler *http_conn::m_sql_sched = NULL;
+user_backend *http_conn::m_user_backend = NULL;
+asset_pack *http_conn::m_asset_pack = NULL;
+long long http_conn::m_send_quota = 256 * 1024;
+int http_conn::m_actor_model = 0;
+int http_conn::m_close_pipe = -1;
+
+//关闭连接，关闭一个连接，客户总量减一；同时释放正在发送的文件(映射或大文件描述符)
+//工作线程正在处理该连接(读写、生成响应，或协程挂起在数据库上)时只从 epoll 删除，套接字保持打开，
+//fd 不会被新连接复用，由最后结束的任务(end_task)完成关闭
 void http_conn::close_conn(bool real_close)
 {
     if (real_close && (m_sockfd != -1))
     {
+        int tasks = __atomic_load_n(&m_tasks, __ATOMIC_SEQ_CST);
+        while (tasks != 0)
+        {
+            if (__atomic_compare_exchange_n(&m_tasks, &tasks, tasks | CLOSE_DEFERRED, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            {
+                if (!(tasks & CLOSE_DEFERRED))
+                    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_sockfd, 0);
+                return;
+            }
+        }
+        unmap();
         removefd(m_epollfd, m_sockfd);
         m_sockfd = -1;
         m_user_count--;
     }
 }
 
+//reactor 模式下连接的关闭(包括定时器的删除)交给主线程，管道写入不超过 PIPE_BUF 是原子的
+//连接可能已被主线程关闭并复用，带上 generation 由主线程核对
+void http_conn::notify_close()
+{
+    close_notice n = {m_sockfd, m_generation};
+    if (n.fd != -1)
+        ::write(m_close_pipe, (char *)&n, sizeof(n));
+}
+
+void http_conn::begin_task()
+{
+    __atomic_add_fetch(&m_tasks, 1, __ATOMIC_SEQ_CST);
+}
+
+//处理期间收到过关闭时，最后结束的任务完成关闭
+bool http_conn::end_task()
+{
+    int left = __atomic_sub_fetch(&m_tasks, 1, __ATOMIC_SEQ_CST);
+    if (!(left & CLOSE_DEFERRED))
+        return true;
+    if (left == CLOSE_DEFERRED)
+    {
+        __atomic_store_n(&m_tasks, 0, __ATOMIC_SEQ_CST);
+        close_conn();
+    }
+    return false;
+}
+
 //初始化连接    需要传参： 套接字，套接字地址
 void http_conn::init(int sockfd, const sockaddr_in &addr) 
 {
     m_sockfd = sockfd;
     m_address = addr;
+    ++m_generation;
     //int reuse=1;
     //setsockopt(m_sockfd,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
     addfd(m_epollfd, sockfd, true);
@@ -154,6 +195,7 @@ void http_conn::init(int sockfd, const sockaddr_in &addr)
 void http_conn::init()
 {
     mysql = NULL;
+    m_co_handle = nullptr;
     bytes_to_send = 0;
     bytes_have_send = 0;
     m_check_state = CHECK_STATE_REQUESTLINE;
@@ -162,14 +204,34 @@ void http_conn::init()
     m_url = 0;
     m_version = 0;
     m_content_length = 0;
+    m_string = NULL;
+    m_location = NULL;
+    m_if_modified_since = NULL;
+    m_if_none_match = NULL;
+    m_accept_gzip = false;
+    m_mime = NULL;
+    m_cacheable = false;
+    m_packed = NULL;
+    m_gzip = false;
+    m_file_len = 0;
+    m_file_fd = -1;
+    m_file_off = 0;
+    m_file.blob.reset();
     m_host = 0;
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
-    m_write_idx = 0;
-    cgi = 0;
+    m_writer.reset();
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_access = false;
+    m_user_agent = NULL;
+    m_referer = NULL;
+    m_status = 0;
+    m_session = NULL;
+    m_session_len = 0;
+    m_new_session[0] = '\0';
     memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
 }
 
@@ -219,6 +281,9 @@ bool http_conn::read_once()
         return false;
     }
     int bytes_read = 0;
+    //请求的第一个字节，访问日志的耗时从这里算起
+    if (m_read_idx == 0 && access_log::get_instance()->enabled())
+        m_start_us = coarse_clock::monotonic_us();
 
 #ifdef connfdLT
 //从套接字接收数据，存储在 m_read_buf 缓冲区
@@ -272,10 +337,7 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     if (strcasecmp(method, "GET") == 0)
         m_method = GET;
     else if (strcasecmp(method, "POST") == 0)
-    {
         m_method = POST;
-        cgi = 1;             // 
-    }
     else
         return BAD_REQUEST;
 
@@ -305,10 +367,12 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     if (!m_url || m_url[0] != '/')
         return BAD_REQUEST;
 
-    // m_url 为请求报文中解析出的请求资源，以/开头，也就是/xxx    
-    //当url为/时，显示判断界面
-    if (strlen(m_url) == 1)
-        strcat(m_url, "judge.html");
+    //抽中的请求保存原始 URL
+    m_access = access_log::get_instance()->sampled();
+    if (m_access)
+        snprintf(m_access_url, ACCESS_URL_LEN, "%s", m_url);
+
+    // m_url 为请求报文中解析出的请求资源，以/开头，也就是/xxx，由 do_request 按路由表处理
 
     m_check_state = CHECK_STATE_HEADER;  // HTTP 请求行处理完毕，状态转移到 头部字段的分析
     return NO_REQUEST;
@@ -353,11 +417,61 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
         m_host = text;
     }
 
+    else if (strncasecmp(text, "User-Agent:", 11) == 0)
+    {
+        text += 11;
+        text += strspn(text, " \t");
+        m_user_agent = text;
+    }
+
+    else if (strncasecmp(text, "Referer:", 8) == 0)
+    {
+        text += 8;
+        text += strspn(text, " \t");
+        m_referer = text;
+    }
+
+    else if (strncasecmp(text, "If-Modified-Since:", 18) == 0)
+    {
+        text += 18;
+        text += strspn(text, " \t");
+        m_if_modified_since = text;
+    }
+
+    else if (strncasecmp(text, "If-None-Match:", 14) == 0)
+    {
+        text += 14;
+        text += strspn(text, " \t");
+        m_if_none_match = text;
+    }
+
+    //只看是否接受 gzip，不处理 q 值
+    else if (strncasecmp(text, "Accept-Encoding:", 16) == 0)
+    {
+        text += 16;
+        m_accept_gzip = strstr(text, "gzip") != NULL;
+    }
+
+    //只取 sid，形如 "a=1; sid=<token>; b=2"，其余 Cookie 忽略
+    else if (strncasecmp(text, "Cookie:", 7) == 0)
+    {
+        text += 7;
+        text += strspn(text, " \t");
+        for (char *c = text; (c = strstr(c, "sid=")) != NULL; c += 4)
+        {
+            if (c == text || c[-1] == ' ' || c[-1] == ';')
+            {
+                m_session = c + 4;
+                m_session_len = strcspn(m_session, "; ");
+                break;
+            }
+        }
+    }
+
     else
     {
         //printf("oop!unknow header: %s\n",text);
-        LOG_INFO("oop!unknow header: %s", text);
-        Log::get_instance()->flush();
+        LOG_DEBUG("oop!unknow header: %s", text);
     }
     return NO_REQUEST;
 }
@@ -377,7 +491,7 @@ http_conn::HTTP_CODE http_conn::parse_content(char *text)
 }
 
 // 主状态机的逻辑处理。 在 主状态机 中调用  从状态机
-//   process_read 函数的返回值是对请求的文件分析后的结果，一部分是语法错误导致的BAD_REQUEST，一部分是do_request的返回结果.
+//   process_read 函数的返回值是对请求报文分析后的结果，一部分是语法错误导致的BAD_REQUEST，请求完整时返回GET_REQUEST，由process再调用do_request.
 http_conn::HTTP_CODE http_conn::process_read()
 {
     LINE_STATUS line_status = LINE_OK;
@@ -392,8 +506,7 @@ http_conn::HTTP_CODE http_conn::process_read()
     {
         text = get_line();               // 重新定义：  char *get_line() { return m_read_buf + m_start_line; };
         m_start_line = m_checked_idx;
-        LOG_INFO("%s", text);           //在日志中记录得到的 http 请求内容
-        Log::get_instance()->flush();
+        LOG_DEBUG("%s", text);          //在日志中记录得到的 http 请求内容
 
 //主状态机的三种状态转移逻辑
         switch (m_check_state)    
@@ -410,9 +523,9 @@ http_conn::HTTP_CODE http_conn::process_read()
             ret = parse_headers(text);
             if (ret == BAD_REQUEST)
                 return BAD_REQUEST;
-            else if (ret == GET_REQUEST)     //完整解析GET请求后，跳转到报文响应函数（因为get 请求没有消息体，不需要parse_content）
+            else if (ret == GET_REQUEST)     //完整解析GET请求后，由 process 调用 do_request 生成响应（因为get 请求没有消息体，不需要parse_content）
             {
-                return do_request();
+                return GET_REQUEST;
             }
             break;
         }
@@ -420,7 +533,7 @@ http_conn::HTTP_CODE http_conn::process_read()
         {
             ret = parse_content(text);
             if (ret == GET_REQUEST)
-                return do_request();
+                return GET_REQUEST;
             line_status = LINE_OPEN;    // 解析完消息体后，报文的解析就完成了。将line_status变量更改为LINE_OPEN，此时可以跳出循环
             break;
         }
@@ -431,173 +544,219 @@ http_conn::HTTP_CODE http_conn::process_read()
     return NO_REQUEST;
 }
 
+//注册时写入用户表的参数，放在协程帧中，挂起期间保持有效
+struct register_args
+{
+    user_backend *backend;
+    const char *name;
+    const char *password;
+};
+
+//协程模式下在数据库线程上执行
+static int register_user(MYSQL *conn, void *ctx)
+{
+    register_args *a = (register_args *)ctx;
+    return a->backend->insert(a->name, a->password, conn);
+}
+
 //（重点）解析得到一个完整的HTTP请求行后，执行 do_request
-// 将网站根目录和url文件拼接，然后通过stat判断该文件属性
-http_conn::HTTP_CODE http_conn::do_request()
+//按路由表找到处理方式，得到要返回的文件后与网站根目录拼接，然后通过stat判断该文件属性
+co_task<http_conn::HTTP_CODE> http_conn::do_request()
 {
     strcpy(m_real_file, doc_root);       //将初始化的m_real_file赋值为网站根目录
     int len = strlen(doc_root);
 
- //找到url中/所在位置，进而判断/后第一个字符
-    const char *p = strrchr(m_url, '/');   //C 库函数 char *strrchr(const char *str, int c) 在参数 str 所指向的字符串中搜索最后一次出现字符 c（一个无符号字符）的位置。
-
-    //处理cgi
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
+    //查找时不含查询串；没有路由的 URL 直接当作网站目录下的文件
+    size_t path_len = strcspn(m_url, "?");
+    const route *r = route_map.match(1u << m_method, m_url, path_len);
+    const char *page = NULL;    //相对网站根目录的文件，NULL 时使用 URL 本身
+
+    //已登录的会话：登录页和登录请求直接进入欢迎页，不解析表单、不查用户表
+    if (r && r->session_page && m_session && session_store::get_instance()->check(m_session, m_session_len))
+        page = r->session_page;
+    else if (r && r->handler == ROUTE_PAGE)
+        page = r->target;
+    else if (r && r->handler == ROUTE_REDIRECT)
     {
-
-        //根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        //将用户名和密码提取出来
-        //user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        //以&为分隔符，前面的为用户名
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-
-        if (*(p + 1) == '3')
+        m_location = r->target;
+        co_return REDIRECT_REQUEST;
+    }
+    else if (r)
+    {
+        bool is_register = r->handler == ROUTE_REGISTER;
+
+        //将用户名和密码提取出来，字段顺序任意，名字和值就地 URL 解码
+        //user=123&password=123
+        //值以 '\0' 结尾并指向 m_read_buf；EPOLLONESHOT 下协程挂起期间不会再读这个连接，缓冲保持不变
+        form_parser form(3 * user_store::MAX_NAME_LEN);
+        std::string_view name_v, password_v;
+        if (m_string && form.parse(m_string, m_content_length))
         {
-            //如果是注册，先检测数据库中是否有重名的
-            //没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end())
+            name_v = form.get("user");
+            password_v = form.get("password");
+        }
+        //缺少字段或解码后超长时按失败处理，不截断
+        bool form_ok = !name_v.empty() && password_v.data() && name_v.size() <= (size_t)user_store::MAX_NAME_LEN &&
+                       password_v.size() <= (size_t)user_store::MAX_PASSWD_LEN;
+        const char *name = name_v.data();
+        const char *password = password_v.data();
+
+        if (!form_ok)
+            page = is_register ? "/registerError.html" : "/logError.html";
+        else if (is_register)
+        {
+            //先在内存中占住用户名，并发注册同名用户时只有一个能继续写入后端
+            user_store *users = user_store::get_instance();
+            user_backend *backend = m_user_backend;
+            page = "/registerError.html";
+            if (users->insert_if_absent(name, password))
             {
-                //向数据库中插入数据时，需要通过锁来同步数据
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
+                int res;
+                //需要数据库连接时，协程模式下在此挂起，插入在数据库线程上完成后再回到工作线程继续
+                if (backend->need_conn())
+                {
+                    register_args args = {backend, name, password};
+                    res = co_await sql_awaiter(m_sql_sched, this, mysql, register_user, &args);
+                }
+                else
+                    res = backend->insert(name, password, NULL);
 
                 if (!res)
-                    strcpy(m_url, "/log.html");
+                    page = "/log.html";
                 else
-                    strcpy(m_url, "/registerError.html");
+                    //写入失败，撤销内存中的用户
+                    users->erase(name);
             }
-            else
-                strcpy(m_url, "/registerError.html");
         }
         //如果是登录，直接判断
-        //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2')
+        else if (user_store::get_instance()->check(name, password))
         {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
+            page = "/welcome.html";
+            //发放会话，之后的请求带上 Cookie 即可直接进入欢迎页；未开启会话时 create 不做任何事
+            session_store::get_instance()->create(name, m_new_session);
         }
+        else
+            page = "/logError.html";
     }
 
-//   /0 跳转到register.html，即注册页面
-    if (*(p + 1) == '0')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        
-        //  将网站目录和/register.html进行拼接，更新到m_real_file中
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-
-        free(m_url_real);
-    }
-    //   /1 跳转到log.html，即登录页面
-    else if (*(p + 1) == '1')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    m_cacheable = !page;
+    //打包部署时只查归档：一次哈希探测，不拼接路径、不 stat、不 open
+    if (m_asset_pack)
+        co_return page ? do_packed_request(page, strlen(page)) : do_packed_request(m_url, path_len);
 
-        free(m_url_real);
-    }
-    //  /5 跳转到picture.html，即图片请求页面
-    else if (*(p + 1) == '5')
+    if (page)
+        strncpy(m_real_file + len, page, FILENAME_LEN - len - 1);
+    else
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-
-        free(m_url_real);
+        //其余的 URL(如欢迎页中的图片)直接与网站目录拼接
+        size_t n = path_len < (size_t)(FILENAME_LEN - len - 1) ? path_len : FILENAME_LEN - len - 1;
+        memcpy(m_real_file + len, m_url, n);
+        m_real_file[len + n] = '\0';
     }
-    //  /6 跳转到video.html，即视频请求页面
-    else if (*(p + 1) == '6')
-    {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
 
-        free(m_url_real);
-    }
-    else if (*(p + 1) == '7')
+    //通过 file_cache 获取请求资源文件信息(一秒内同一文件不重复 stat)，成功则将信息更新到m_file结构体
+    //失败返回NO_RESOURCE状态，表示资源不存在
+    if (!file_cache::get_instance()->lookup(m_real_file, &m_file))
+        co_return NO_RESOURCE;
+
+    if (!(m_file.st.st_mode & S_IROTH))     //判断文件的权限，是否可读，不可读则返回FORBIDDEN_REQUEST状态
+        co_return FORBIDDEN_REQUEST;
+    if (S_ISDIR(m_file.st.st_mode))        //判断文件类型，如果是目录，则返回BAD_REQUEST，表示请求报文有误
+        co_return BAD_REQUEST;
+
+    m_mime = m_file.mime;
+    m_file_len = m_file.st.st_size;
+    //与上次发出的 Last-Modified 完全相同时认为浏览器的缓存仍然有效，不映射文件
+    if (m_cacheable && m_if_modified_since && strcmp(m_if_modified_since, m_file.last_modified) == 0)
+        co_return NOT_MODIFIED;
+
+    //预热过的文件直接发送内存中的内容
+    if (m_file.blob)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-
-        free(m_url_real);
+        m_file_address = m_file.blob->addr;
+        co_return FILE_REQUEST;
     }
-        //如果以上均不符合，即不是登录和注册，直接将url与网站目录拼接
-        //这里的情况是welcome界面，请求服务器上的一个图片
-    else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
-
-
-    //通过stat获取请求资源文件信息，成功则将信息更新到m_file_stat结构体
-    //失败返回NO_RESOURCE状态，表示资源不存在
-    if (stat(m_real_file, &m_file_stat) < 0)  
-        return NO_RESOURCE;
-
-    if (!(m_file_stat.st_mode & S_IROTH))     //判断文件的权限，是否可读，不可读则返回FORBIDDEN_REQUEST状态
-        return FORBIDDEN_REQUEST;
-    if (S_ISDIR(m_file_stat.st_mode))        //判断文件类型，如果是目录，则返回BAD_REQUEST，表示请求报文有误
-        return BAD_REQUEST;
 
     int fd = open(m_real_file, O_RDONLY);     //以只读方式获取文件描述符，通过mmap将该文件映射到内存中
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd < 0)
+        co_return NO_RESOURCE;
+    //音视频、压缩包等适合 sendfile 的大文件，以及任何类型的超大文件(32 位长度和地址空间都不够用)不整体映射：
+    //保留描述符，发送时顺序预读、分块 sendfile；页面、样式、图片等仍然映射
+    if (m_file_len >= MAP_MAX || (m_file_len >= STREAM_MIN && m_mime->sendfile))
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        m_file_fd = fd;
+        m_file_off = 0;
+        co_return FILE_REQUEST;
+    }
+    m_file_address = (char *)mmap(0, m_file.st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
    
     close(fd);
 
-    return FILE_REQUEST;            //表示请求文件存在，且可以访问
+    co_return FILE_REQUEST;            //表示请求文件存在，且可以访问
+}
+
+//归档中的文件：ETag 优先于 Last-Modified 判断 304，浏览器接受时发送 gzip 版本
+http_conn::HTTP_CODE http_conn::do_packed_request(const char *path, size_t len)
+{
+    m_packed = m_asset_pack->find(path, len);
+    if (!m_packed)
+        return NO_RESOURCE;
+    m_mime = m_packed->mime;
+    if (m_cacheable)
+    {
+        //If-None-Match 可以是多个 ETag 的列表或 "*"，按弱比较只看是否包含
+        bool fresh = m_if_none_match ? strcmp(m_if_none_match, "*") == 0 || strstr(m_if_none_match, m_packed->etag)
+                                     : m_if_modified_since && strcmp(m_if_modified_since, m_packed->last_modified) == 0;
+        if (fresh)
+            return NOT_MODIFIED;
+    }
+    m_gzip = m_packed->gz_data && m_accept_gzip;
+    m_file_address = (char *)(m_gzip ? m_packed->gz_data : m_packed->data);
+    m_file_len = m_gzip ? m_packed->gz_length : m_packed->length;
+    return FILE_REQUEST;
 }
 
-// 对内存映射区执行 munmap 
+// 对内存映射区执行 munmap ，大文件关闭描述符
 void http_conn::unmap()
 {
-    if (m_file_address)
+    if (m_file_fd >= 0)
+    {
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+    if (m_packed)
+    {
+        //归档在整个运行期间保持映射
+        m_packed = NULL;
+        m_file_address = 0;
+    }
+    else if (m_file.blob)
+    {
+        //预热的内容由 file_cache 管理，这里只释放引用
+        m_file.blob.reset();
+        m_file_address = 0;
+    }
+    else if (m_file_address)
     {
-        munmap(m_file_address, m_file_stat.st_size);
+        munmap(m_file_address, m_file_len);
         m_file_address = 0;
     }
 }
 
 //  子线程调用 process_write 完成响应报文，随后注册epollout事件。
 //  主线程检测写事件，并调用 http_conn::write 函数将响应报文发送给浏览器端。
+//  每次最多发送 m_send_quota 字节，用完后重新注册写事件让出，套接字仍可写时 epoll 会立即再次通知，
+//  其他连接的读写因此不会被一个快速读取的大文件下载挡住
 bool http_conn::write()
 {
-    int temp = 0;
+    ssize_t temp = 0;
+    long long quota = m_send_quota > 0 ? m_send_quota : LLONG_MAX;
 
     if (bytes_to_send == 0)
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
         init();
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
         return true;
     }
 // 循环发送
@@ -605,7 +764,19 @@ bool http_conn::write()
     {
         // int writev(int fd, const struct iovec *vector, int count);
 // writev 函数用于在一次函数调用中写多个非连续缓冲区，有时也将该函数称为聚集写。
-        temp = writev(m_sockfd, m_iv, m_iv_count);           
+        //响应头发完后，大文件的内容由 sendfile 从页缓存直接发送，每次不超过剩余的配额
+        if (m_iv_idx < m_iv_count)
+            temp = writev(m_sockfd, m_iv + m_iv_idx, m_iv_count - m_iv_idx);
+        else
+        {
+            temp = sendfile(m_sockfd, m_file_fd, &m_file_off, std::min(bytes_to_send, quota));
+            //文件在发送途中被截断，无法发完已声明的长度
+            if (temp == 0)
+            {
+                unmap();
+                return false;
+            }
+        }
 
         if (temp < 0)  // 根据返回值更新byte_have_send和iovec结构体的指针和长度
         {
@@ -618,29 +789,33 @@ bool http_conn::write()
             return false;
         }
 
-        bytes_have_send += temp;      // 已经发送的
-        bytes_to_send -= temp;        //  待发送的
-        if (bytes_have_send >= m_iv[0].iov_len)
+        long long sent = temp;
+        bytes_have_send += sent;      // 已经发送的
+        bytes_to_send -= sent;        //  待发送的
+        //writev 发送时跳过已经发完的 iovec，调整第一个只发了一部分的 iovec 的基址和长度；sendfile 不涉及 iovec
+        if (m_iv_idx < m_iv_count)
         {
-            m_iv[0].iov_len = 0;
-            // 重新计算 iovec 的基址和长度, m_write_idx 表示 响应报文的长度，即 m_iv[0].iov_len 的大小
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);  
-            m_iv[1].iov_len = bytes_to_send;
-        }
-        else
-        {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
+            while (m_iv_idx < m_iv_count && (size_t)temp >= m_iv[m_iv_idx].iov_len)
+                temp -= m_iv[m_iv_idx++].iov_len;
+            if (temp > 0)
+            {
+                m_iv[m_iv_idx].iov_base = (char *)m_iv[m_iv_idx].iov_base + temp;
+                m_iv[m_iv_idx].iov_len -= temp;
+            }
         }
 
         if (bytes_to_send <= 0)
         {
             unmap();       // 若响应报文整体发送成功,则取消 mmap 映射,并判断是否是长连接.
-            modfd(m_epollfd, m_sockfd, EPOLLIN);
+            if (m_access)
+                log_access();
 
+            //先重置再注册读事件：reactor 模式下重新注册后下一个请求可能立即被别的工作线程处理
+            //短连接不再注册，避免对端关闭产生的事件与关闭流程竞争
             if (m_linger)     // 长连接重置http类实例，注册读事件，不关闭连接
             {
                 init();
+                modfd(m_epollfd, m_sockfd, EPOLLIN);
                 return true;
             }
             else
@@ -648,143 +823,178 @@ bool http_conn::write()
                 return false;
             }
         }
+
+        //按本轮实际发送的字节数扣减配额
+        quota -= sent;
+        if (quota <= 0)
+        {
+            modfd(m_epollfd, m_sockfd, EPOLLOUT);
+            return true;
+        }
     }
 }
 
-// 往 写缓冲中 写入待发送的数据
-bool http_conn::add_response(const char *format, ...)
+//响应发送完毕后记录一行访问日志
+void http_conn::log_access()
 {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)                // m_write_idx 写缓冲区中待发送的字节数
-        return false;
-
-    //定义可变参数列表
-    va_list arg_list;
-    //将变量arg_list初始化为传入参数
-    va_start(arg_list, format);
-
-    //将数据format从可变参数列表写入缓冲区写，返回写入数据的长度
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
-    {
-        va_end(arg_list);
-        return false;
-    }
-
-    //更新m_write_idx位置
-    m_write_idx += len;
-    //清空可变参列表
-    va_end(arg_list);
-
-    // 日志文件记录  
-    LOG_INFO("request:%s", m_write_buf);
-    Log::get_instance()->flush();  // 同步日志
-
-    return true;
+    access_entry e;
+    e.m_addr = &m_address;
+    e.m_method = method_name[m_method];
+    e.m_url = m_access_url;
+    e.m_status = m_status;
+    e.m_bytes = bytes_have_send;
+    e.m_latency_us = coarse_clock::monotonic_us() - m_start_us;
+    e.m_referer = m_referer;
+    e.m_user_agent = m_user_agent;
+    access_log::get_instance()->write(e);
 }
 
 //添加状态行
 bool http_conn::add_status_line(int status, const char *title)
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    m_status = status;
+    return add_response("HTTP/1.1 ") && m_writer.append_uint(status) && add_response(" ") && add_response(title) &&
+           add_response("\r\n");
 }
-//添加消息报头，具体的添加文本长度、连接状态和空行
-bool http_conn::add_headers(int content_len)
+//添加消息报头，具体的添加文本长度、类型、编码、缓存策略、日期、连接状态和空行；content_len 小于 0 时不带长度(304)
+bool http_conn::add_headers(long long content_len)
 {
-    add_content_length(content_len);
-    add_linger();
-    add_blank_line();
+    return (content_len < 0 || add_content_length(content_len)) && add_content_type() && add_content_encoding() &&
+           add_cache_headers() && m_writer.append_date() && add_set_cookie() && add_location() && add_linger() &&
+           add_blank_line();
 }
 //添加Content-Length，表示响应报文的长度
-bool http_conn::add_content_length(int content_len)
+bool http_conn::add_content_length(long long content_len)
 {
-    return add_response("Content-Length:%d\r\n", content_len);
+    return add_response("Content-Length:") && m_writer.append_uint(content_len) && add_response("\r\n");
 }
+//文件按扩展名对应的类型，服务器生成的页面为 text/html
 bool http_conn::add_content_type()
 {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    if (!m_mime)
+        return add_response("Content-Type:text/html\r\n");
+    return add_response("Content-Type:") && add_response(m_mime->type) && add_response("\r\n");
+}
+//文件的 Last-Modified 以及类型对应的 Cache-Control、Expires
+bool http_conn::add_cache_headers()
+{
+    if (!m_mime || !m_cacheable)
+        return true;
+    const char *expires = expires_line(m_mime->cache);
+    const char *last_modified = m_packed ? m_packed->last_modified : m_file.last_modified;
+    return add_response("Last-Modified:") && add_response(std::string_view(last_modified, HTTP_DATE_LEN)) &&
+           add_response("\r\n") && (!m_packed || add_etag()) &&
+           add_response(cache_control_line(m_mime->cache)) && (!expires || add_response(expires));
+}
+//有 gzip 版本时两种编码共用一个 ETag，只能作为弱 ETag
+bool http_conn::add_etag()
+{
+    return add_response(m_packed->gz_data ? "ETag:W/" : "ETag:") && add_response(m_packed->etag) && add_response("\r\n");
+}
+//归档中有 gzip 版本的文件按 Accept-Encoding 选择发送哪个，都要带 Vary
+bool http_conn::add_content_encoding()
+{
+    if (!m_packed || !m_packed->gz_data)
+        return true;
+    return (!m_gzip || add_response("Content-Encoding:gzip\r\n")) && add_response("Vary:Accept-Encoding\r\n");
 }
 bool http_conn::add_linger()
 {
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    return add_response(m_linger ? "Connection:keep-alive\r\n" : "Connection:close\r\n");
+}
+//登录成功时发放会话 Cookie，有效期与服务端会话一致
+bool http_conn::add_set_cookie()
+{
+    if (!m_new_session[0])
+        return true;
+    return add_response("Set-Cookie:sid=") && add_response(std::string_view(m_new_session, session_store::TOKEN_LEN)) &&
+           add_response("; Max-Age=") && m_writer.append_uint(session_store::get_instance()->ttl()) &&
+           add_response("; Path=/; HttpOnly; SameSite=Lax\r\n");
+}
+bool http_conn::add_location()
+{
+    if (!m_location)
+        return true;
+    return add_response("Location:") && add_response(m_location) && add_response("\r\n");
 }
 bool http_conn::add_blank_line()
 {
-    return add_response("%s", "\r\n");
+    return add_response("\r\n");
 }
 bool http_conn::add_content(const char *content)
 {
-    return add_response("%s", content);
+    return add_response(content);
+}
+//响应头(固定缓冲和溢出段)之后跟文件内容，依次放进 iovec；file 为 NULL 时文件内容由 sendfile 发送
+void http_conn::set_iovec(char *file, size_t file_len)
+{
+    m_iv_count = m_writer.fill_iovec(m_iv);
+    if (file && file_len)
+    {
+        m_iv[m_iv_count].iov_base = file;
+        m_iv[m_iv_count].iov_len = file_len;
+        ++m_iv_count;
+    }
+    m_iv_idx = 0;
+    bytes_to_send = m_writer.size() + file_len;
 }
 
 
-// 根据do_request的返回状态，服务器子线程调用 process_write 向 m_write_buf 中写入响应报文。
-//响应报文分为两种，一种是请求文件的存在，通过io向量机制iovec，声明两个iovec，第一个指向m_write_buf，第二个指向mmap的地址m_file_address；
-//一种是请求出错，这时候只申请一个iovec，指向m_write_buf。
+// 根据do_request的返回状态，服务器子线程调用 process_write 写入响应报文。
+//响应报文分为两种，一种是请求文件的存在，通过io向量机制iovec，前面的iovec指向响应头，最后一个指向mmap的地址m_file_address；
+//一种是请求出错，这时候只有响应头(含错误页面)的iovec。
 //iovec是一个结构体，里面有两个元素，指针成员  iov_base 指向一个缓冲区，这个缓冲区是存放的是writev将要发送的数据。
 //成员iov_len表示实际写入的长度
 
 bool http_conn::process_write(HTTP_CODE ret)
 {
+    const char *form = NULL;     //错误页面等放在响应头后面的内容
     switch (ret)
     {
     case INTERNAL_ERROR:   // 内部错误  500
-    {
         add_status_line(500, error_500_title);
-        add_headers(strlen(error_500_form));
-        if (!add_content(error_500_form))
-            return false;
+        form = error_500_form;
         break;
-    }
     case BAD_REQUEST:      //报文语法有误，404
-    {
+    case NO_RESOURCE:      //文件不存在，404
         add_status_line(404, error_404_title);
-        add_headers(strlen(error_404_form));
-        if (!add_content(error_404_form))
-            return false;
+        form = error_404_form;
         break;
-    }
     case FORBIDDEN_REQUEST:     //资源没有访问权限，403
-    {
         add_status_line(403, error_403_title);
-        add_headers(strlen(error_403_form));
-        if (!add_content(error_403_form))
-            return false;
+        form = error_403_form;
         break;
-    }
+    case REDIRECT_REQUEST:      //跳转，302
+        add_status_line(302, redirect_302_title);
+        form = "";
+        break;
+    case NOT_MODIFIED:          //浏览器缓存仍然有效，304，没有消息体
+        add_status_line(304, not_modified_304_title);
+        if (!add_headers(-1))
+            return false;
+        set_iovec(NULL, 0);
+        return true;
     case FILE_REQUEST:   // 访问成功，文件存在，200
-    {
         add_status_line(200, ok_200_title);
         // 如果请求的资源存在
-        if (m_file_stat.st_size != 0)
-        {
-            add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;            // 第一个iovec指针指向响应报文缓冲区，长度指向m_write_idx
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;        //  第二个iovec指针指向mmap返回的文件指针，长度指向文件大小
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;      // 被写的内存块数量
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
-            return true;
-        }
-        else
+        if (m_file_len != 0)
         {
-            const char *ok_string = "<html><body></body></html>";
-            add_headers(strlen(ok_string));
-            if (!add_content(ok_string))
+            if (!add_headers(m_file_len))
                 return false;
+            set_iovec(m_file_fd >= 0 ? NULL : m_file_address, m_file_len);
+            return true;
         }
-    }
+        form = "<html><body></body></html>";
+        break;
     default:
         return false;
     }
-    
-    // 除FILE_REQUEST状态外，其余状态只申请一个iovec，指向响应报文缓冲区
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;   
 
-    bytes_to_send = m_write_idx;   // 在生成响应报文时初始化 byte_to_send，包括头部信息和文件数据大小。
+    size_t len = strlen(form);
+    if (!add_headers(len) || !add_response(std::string_view(form, len)))
+        return false;
+    // 除FILE_REQUEST状态外，只有响应头的iovec
+    set_iovec(NULL, 0);
     return true;
 }
 
@@ -792,20 +1002,43 @@ bool http_conn::process_write(HTTP_CODE ret)
 
 // 由线程池中的工作线程调用。处理 HTTP请求的入口函数
 //各子线程通过process函数对任务进行处理，调用process_read函数和process_write函数分别完成报文解析与报文响应两个任务。
-void http_conn::process()
+//调用前已 begin_task，每条返回路径最后 end_task(协程挂起时由恢复后的执行完成)
+co_detached http_conn::process()
 {
     HTTP_CODE read_ret = process_read();
     if (read_ret == NO_REQUEST)          // 请求不完整，继续请求
     { 
         //注册并监听读事件
         modfd(m_epollfd, m_sockfd, EPOLLIN);
-        return;
+        end_task();
+        co_return;
+    }
+    if (read_ret == GET_REQUEST)         // 请求完整，生成响应(可能在此挂起等待数据库)
+    {
+        read_ret = co_await do_request();
+        //挂起期间连接已被关闭(如定时器超时)，不再发送响应，由 end_task 完成推迟的关闭
+        if (__atomic_load_n(&m_tasks, __ATOMIC_SEQ_CST) & CLOSE_DEFERRED)
+        {
+            end_task();
+            co_return;
+        }
     }
     bool write_ret = process_write(read_ret);
     if (!write_ret)
     {
         close_conn();
+        end_task();
+        co_return;
+    }
+    //reactor 模式下工作线程直接发送，写满内核缓冲区时 write 会自行注册写事件
+    if (1 == m_actor_model)
+    {
+        if (!write())
+            notify_close();
+        end_task();
+        co_return;
     }
     //注册并监听写事件
     modfd(m_epollfd, m_sockfd, EPOLLOUT);
+    end_task();
 }
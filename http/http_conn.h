@@ -19,14 +19,30 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "../coroutine/co_task.h"
+#include "../coroutine/co_sql.h"
+#include "../session/session_store.h"
+#include "response_writer.h"
+#include "file_cache.h"
+#include "../pack/asset_pack.h"
+
+class user_backend;
+
+extern const char *doc_root;            //网站根目录
+
 class http_conn
 {
 public:
     static const int FILENAME_LEN = 200;              // 文件名的最大长度
     static const int READ_BUFFER_SIZE = 2048;
     static const int WRITE_BUFFER_SIZE = 1024;
+    static const int ACCESS_URL_LEN = 256;            // 访问日志中记录的 URL 的最大长度
+    static const size_t STREAM_MIN = 1024 * 1024;     // 适合 sendfile 的类型(mime_type::sendfile)不小于此大小时不整体映射，保留描述符分块 sendfile
+    static const size_t MAP_MAX = 256 * 1024 * 1024;  // 其他类型不小于此大小时同样分块 sendfile
+    static const int CLOSE_DEFERRED = 1 << 30;        // m_tasks 的标志位：处理期间收到了关闭，由最后结束的任务完成
     enum METHOD                         // HTTP 请求的方法
     {
         GET = 0,
@@ -53,6 +69,8 @@ public:
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        REDIRECT_REQUEST,                  // 路由要求跳转，m_location 为目标地址
+        NOT_MODIFIED,                      // 文件自 If-Modified-Since 以来没有变化，304
         INTERNAL_ERROR,                    // 服务器内部错误
         CLOSED_CONNECTION
     };
@@ -64,20 +82,34 @@ public:
     };
 
 public:
-    http_conn() {}
+    //reactor 模式下工作线程请主线程关闭连接时写入管道的内容，generation 用于丢弃已被复用的连接的请求
+    struct close_notice
+    {
+        int fd;
+        unsigned generation;
+    };
+
+public:
+    http_conn() : m_generation(0), m_tasks(0), m_file_address(NULL), m_file_fd(-1), m_packed(NULL) {}
     ~http_conn() {}
 
 public:
     void init(int sockfd, const sockaddr_in &addr);
     void close_conn(bool real_close = true);
-    void process();                            //  处理 客户请求
+    co_detached process();                     //  处理 客户请求，等待数据库时挂起而不占用工作线程
     bool read_once();                          //  非阻塞 读
     bool write();                             //   响应报文的写入函数 非阻塞
+    void notify_close();                      //   reactor 模式下请主线程关闭连接
+    void begin_task();                        //   工作线程开始处理连接，期间的关闭推迟到 end_task
+    bool end_task();                          //   结束处理，连接已被关闭(完成了推迟的关闭)时返回 false
     sockaddr_in *get_address()
     {
         return &m_address;
     }
-    void initmysql_result(connection_pool *connPool);
+    unsigned generation() const
+    {
+        return m_generation;
+    }
 
 private:
     void init();
@@ -88,33 +120,51 @@ private:
     HTTP_CODE parse_request_line(char *text);
     HTTP_CODE parse_headers(char *text);
     HTTP_CODE parse_content(char *text);
-    HTTP_CODE do_request();            // 生成响应报文
+    co_task<HTTP_CODE> do_request();   // 生成响应报文
+    HTTP_CODE do_packed_request(const char *path, size_t len);  // 从静态资源归档中取文件
 
     char *get_line() { return m_read_buf + m_start_line; };   // 用于将 指针向后偏移，指向未处理的字符
     LINE_STATUS parse_line();                   
     
     void unmap();
+    void log_access();
 
  //根据响应报文格式，生成对应8个部分，以下函数均由do_request调用
-    bool add_response(const char *format, ...);
+    bool add_response(std::string_view s) { return m_writer.append(s); }
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
-    bool add_headers(int content_length);
+    bool add_headers(long long content_length);
     bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_content_length(long long content_length);
     bool add_linger();
+    bool add_set_cookie();
+    bool add_location();
+    bool add_cache_headers();
+    bool add_content_encoding();
+    bool add_etag();
     bool add_blank_line();
+    void set_iovec(char *file, size_t file_len);
 
 public:
 //  所有 socket 上的事件都被注册到同一个 epoll内核事件表，所以 设置为 static类型
     static int m_epollfd;
     static int m_user_count;
+    static sql_scheduler *m_sql_sched;      // 非空时数据库操作以协程方式挂起等待
+    static user_backend *m_user_backend;    // 注册时持久化新用户的存储后端
+    static asset_pack *m_asset_pack;        // 非空时静态文件全部来自该归档，不再访问网站目录
+    static int m_actor_model;               // 0 模拟proactor，1 reactor
+    static int m_close_pipe;                // reactor 模式下工作线程通知主线程关闭连接的管道写端
+    static long long m_send_quota;          // 每次可写事件最多发送的字节数，用完后让出，0 为不限制
     MYSQL *mysql;
+    int m_state;                            // reactor 模式下待处理的事件：0 读，1 写
+    std::coroutine_handle<> m_co_handle;    // 数据库任务完成后待恢复的协程
 
 private:
    // HTTP 连接的 socket 和对方的 socket 地址
     int m_sockfd;
     sockaddr_in m_address;
+    unsigned m_generation;      // 每接受一个新连接加一，区分复用同一 fd 的前后两个连接
+    int m_tasks;                // 工作线程上进行中的任务数(含挂起的协程)，可带 CLOSE_DEFERRED；用原子操作读写
     
     // 读缓冲区
     char m_read_buf[READ_BUFFER_SIZE];
@@ -126,10 +176,8 @@ private:
     // 当前正在解析 的行的起始位置
     int m_start_line;
     
-    // 写缓冲区
-    char m_write_buf[WRITE_BUFFER_SIZE];
-    // 写缓冲区 待发送的字节数
-    int m_write_idx;
+    // 响应头：WRITE_BUFFER_SIZE 字节的固定缓冲，超出的部分写入溢出段
+    response_writer<WRITE_BUFFER_SIZE> m_writer;
     
     // 主状态机当前所在的状态
     CHECK_STATE m_check_state;
@@ -145,18 +193,41 @@ private:
     bool m_linger;             // HTTP 请求是否保持长连接
     
     char *m_file_address;      // 读取服务器上的文件地址
-    // 目标文件的状态。 通过它 来判断 目标文件是否存在，是否为目录，是否可读，并获取文件的大小
-    struct stat m_file_stat;
+    size_t m_file_len;         // 要发送的文件内容长度
+    int m_file_fd;             // 大文件不映射，由 sendfile 从该描述符分块发送，否则为 -1
+    off_t m_file_off;          // 大文件下一次 sendfile 的偏移
+    // 目标文件的状态、类型与缓存策略，来自 file_cache。 通过它 来判断 目标文件是否存在，是否为目录，是否可读，并获取文件的大小
+    file_meta m_file;
+    const mime_type *m_mime;   // 非 NULL 时响应头带文件的类型
+    bool m_cacheable;          // URL 直接对应文件时才带缓存头、响应 304；路由页面随登录状态和表单结果变化
+    const packed_file *m_packed;    // 来自归档的文件，内容指向归档的映射区
+    bool m_gzip;               // 发送归档中的 gzip 版本
     
     
-    struct iovec m_iv[2];  // 使用 writev 执行写操作  指向一个缓冲区
+    struct iovec m_iv[3];  // 使用 writev 执行写操作：响应头、溢出段、文件
     int m_iv_count;         // 被写内存块的数量
+    int m_iv_idx;           // 第一个还没发完的内存块
     
-    int cgi;        
     char *m_string; //存储请求头数据
+    const char *m_location;     //跳转的目标地址，指向路由表
+    const char *m_if_modified_since;    //请求中的 If-Modified-Since，指向读缓冲
+    const char *m_if_none_match;        //请求中的 If-None-Match，指向读缓冲
+    bool m_accept_gzip;                 //Accept-Encoding 中有 gzip
+
+    const char *m_session;      //请求 Cookie 中的 sid，指向读缓冲
+    int m_session_len;
+    char m_new_session[session_store::TOKEN_LEN + 1];  //本次登录发放的 token，非空时响应带 Set-Cookie
     
-    int bytes_to_send;
-    int bytes_have_send;
+    long long bytes_to_send;
+    long long bytes_have_send;
+
+    // 访问日志，只在 m_access 为真(该请求被抽中)时使用
+    bool m_access;
+    long long m_start_us;                   // 读到请求第一个字节的时间
+    char m_access_url[ACCESS_URL_LEN];      // 原始 URL
+    char *m_user_agent;
+    char *m_referer;
+    int m_status;
 };
 
 #endif
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <time.h>
+#include <string_view>
+#include "mime_types.h"
+#include "response_writer.h"
+#include "../timer/coarse_clock.h"
+
+//按扩展名排序，新增类型时保持顺序
+static constexpr mime_type mime_table[] = {
+    {"avi", "video/x-msvideo", CACHE_LONG, false, true},
+    {"bmp", "image/bmp", CACHE_LONG, true, false},
+    {"css", "text/css; charset=utf-8", CACHE_SHORT, true, false},
+    {"gif", "image/gif", CACHE_LONG, false, false},
+    {"htm", "text/html; charset=utf-8", CACHE_REVALIDATE, true, false},
+    {"html", "text/html; charset=utf-8", CACHE_REVALIDATE, true, false},
+    {"ico", "image/x-icon", CACHE_LONG, true, false},
+    {"jpeg", "image/jpeg", CACHE_LONG, false, false},
+    {"jpg", "image/jpeg", CACHE_LONG, false, false},
+    {"js", "application/javascript; charset=utf-8", CACHE_SHORT, true, false},
+    {"json", "application/json", CACHE_REVALIDATE, true, false},
+    {"mp3", "audio/mpeg", CACHE_LONG, false, true},
+    {"mp4", "video/mp4", CACHE_LONG, false, true},
+    {"pdf", "application/pdf", CACHE_LONG, false, true},
+    {"png", "image/png", CACHE_LONG, false, false},
+    {"svg", "image/svg+xml", CACHE_LONG, true, false},
+    {"txt", "text/plain; charset=utf-8", CACHE_REVALIDATE, true, false},
+    {"wasm", "application/wasm", CACHE_SHORT, true, false},
+    {"webm", "video/webm", CACHE_LONG, false, true},
+    {"webp", "image/webp", CACHE_LONG, false, false},
+    {"woff", "font/woff", CACHE_LONG, false, false},
+    {"woff2", "font/woff2", CACHE_LONG, false, false},
+    {"xml", "application/xml", CACHE_REVALIDATE, true, false},
+    {"zip", "application/zip", CACHE_LONG, false, true},
+};
+static const mime_type default_type = {"", "application/octet-stream", CACHE_REVALIDATE, false, true};
+static const size_t MIME_COUNT = sizeof(mime_table) / sizeof(mime_table[0]);
+//扩展名的最大长度，更长的直接按未知类型处理
+static const size_t MAX_EXT = 8;
+
+static constexpr bool mime_table_sorted()
+{
+    for (size_t i = 1; i < MIME_COUNT; ++i)
+        if (!(std::string_view(mime_table[i - 1].ext) < std::string_view(mime_table[i].ext)))
+            return false;
+    for (size_t i = 0; i < MIME_COUNT; ++i)
+        if (std::string_view(mime_table[i].ext).size() > MAX_EXT)
+            return false;
+    return true;
+}
+static_assert(mime_table_sorted(), "mime_table must be sorted by extension, without duplicates");
+
+//有效期(秒)与 Cache-Control 行，下标为 cache_class
+static const int cache_max_age[CACHE_CLASS_COUNT] = {0, 3600, 7 * 24 * 3600};
+static const char *cache_control[CACHE_CLASS_COUNT] = {
+    "Cache-Control:no-cache\r\n",
+    "Cache-Control:public, max-age=3600\r\n",
+    "Cache-Control:public, max-age=604800\r\n",
+};
+
+const mime_type *mime_lookup(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/'))
+        return &default_type;
+    char ext[MAX_EXT];
+    size_t n = 0;
+    for (const char *p = dot + 1; *p; ++p)
+    {
+        if (n == MAX_EXT)
+            return &default_type;
+        char c = *p;
+        ext[n++] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    std::string_view key(ext, n);
+
+    size_t lo = 0, hi = MIME_COUNT;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        int cmp = key.compare(mime_table[mid].ext);
+        if (cmp == 0)
+            return &mime_table[mid];
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return &default_type;
+}
+
+const char *cache_control_line(cache_class c)
+{
+    return cache_control[c];
+}
+
+const char *expires_line(cache_class c)
+{
+    if (cache_max_age[c] <= 0)
+        return NULL;
+    static thread_local char lines[CACHE_CLASS_COUNT][HTTP_DATE_LEN + 11];
+    static thread_local time_t cached[CACHE_CLASS_COUNT];
+    time_t now = coarse_clock::now_sec();
+    if (cached[c] != now)
+    {
+        memcpy(lines[c], "Expires:", 8);
+        format_http_date(lines[c] + 8, now + cache_max_age[c]);
+        memcpy(lines[c] + 8 + HTTP_DATE_LEN, "\r\n", 3);
+        cached[c] = now;
+    }
+    return lines[c];
+}
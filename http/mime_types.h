@@ -0,0 +1,37 @@
+/*************************************************************
+*扩展名 -> MIME 类型以及该类型的响应策略：
+*缓存策略(Cache-Control/Expires)、是否值得压缩、大文件是否适合 sendfile
+*类型表在编译期按扩展名排好序(未排序或重复时编译失败)，查找为二分
+*每个文件只在第一次访问(或文件变化)时查一次，结果随文件元数据缓存在 file_cache 中
+**************************************************************/
+
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+#include <stddef.h>
+
+enum cache_class
+{
+    CACHE_REVALIDATE = 0,   //每次都向服务器确认(If-Modified-Since)，如页面
+    CACHE_SHORT,            //一小时，如样式表和脚本
+    CACHE_LONG,             //七天，如图片、字体和音视频
+    CACHE_CLASS_COUNT
+};
+
+struct mime_type
+{
+    const char *ext;        //小写，不含 '.'
+    const char *type;
+    cache_class cache;
+    bool compressible;      //文本类内容，压缩收益明显
+    bool sendfile;          //大文件适合 sendfile 直接发送，不必映射进内存
+};
+
+//按路径的扩展名查找，未知类型返回 application/octet-stream
+const mime_type *mime_lookup(const char *path);
+//"Cache-Control:...\r\n" 行
+const char *cache_control_line(cache_class c);
+//"Expires:...\r\n" 行(当前时间加上有效期)，每个线程每秒格式化一次；CACHE_REVALIDATE 返回 NULL
+const char *expires_line(cache_class c);
+
+#endif
@@ -0,0 +1,79 @@
+#include <time.h>
+#include "response_writer.h"
+#include "../timer/coarse_clock.h"
+
+//"00" 到 "99" 的两位数字，每次写两位
+static const char digits2[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static size_t count_digits(unsigned long long v)
+{
+    size_t n = 1;
+    for (;;)
+    {
+        if (v < 10)
+            return n;
+        if (v < 100)
+            return n + 1;
+        if (v < 1000)
+            return n + 2;
+        if (v < 10000)
+            return n + 3;
+        v /= 10000;
+        n += 4;
+    }
+}
+
+size_t format_uint(char *out, unsigned long long v)
+{
+    size_t n = count_digits(v);
+    char *p = out + n;
+    while (v >= 100)
+    {
+        unsigned i = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = digits2[i + 1];
+        *--p = digits2[i];
+    }
+    if (v >= 10)
+    {
+        unsigned i = (unsigned)v * 2;
+        *--p = digits2[i + 1];
+        *--p = digits2[i];
+    }
+    else
+        *--p = (char)('0' + v);
+    return n;
+}
+
+void format_http_date(char *out, time_t t)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(out, HTTP_DATE_LEN + 1, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+const char *http_date_line()
+{
+    //每个线程各自缓存，不需要加锁
+    static thread_local char line[HTTP_DATE_LINE_LEN + 1];
+    static thread_local time_t cached = -1;
+    time_t now = coarse_clock::now_sec();
+    if (now != cached)
+    {
+        memcpy(line, "Date:", 5);
+        format_http_date(line + 5, now);
+        memcpy(line + 5 + HTTP_DATE_LEN, "\r\n", 3);
+        cached = now;
+    }
+    return line;
+}
@@ -0,0 +1,85 @@
+/*************************************************************
+*响应头写入：固定片段直接 memcpy(字面量的长度在编译期确定)，数字用查表的 itoa，
+*Date 头每个线程每秒只格式化一次；不使用 vsnprintf
+*响应头先写进 SIZE 字节的固定缓冲，放不下时后续内容写入溢出段，两段各占一个 iovec；
+*溢出段的容量在连接上保留，之后同样大小的响应不再分配内存
+**************************************************************/
+
+#ifndef RESPONSE_WRITER_H
+#define RESPONSE_WRITER_H
+
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <string>
+#include <string_view>
+
+//把 v 的十进制写入 out，返回位数，out 至少 20 字节
+size_t format_uint(char *out, unsigned long long v);
+//HTTP 日期，如 "Sun, 06 Nov 1994 08:49:37 GMT"，固定 HTTP_DATE_LEN 字节，out 至少 HTTP_DATE_LEN + 1 字节
+const size_t HTTP_DATE_LEN = 29;
+void format_http_date(char *out, time_t t);
+//当前时间的 "Date:...\r\n" 行，指向线程局部缓冲，长度为 HTTP_DATE_LINE_LEN
+const char *http_date_line();
+const size_t HTTP_DATE_LINE_LEN = HTTP_DATE_LEN + 7;
+
+template <size_t SIZE>
+class response_writer
+{
+public:
+    //溢出段的上限，只作为保护，服务器自己生成的响应头远小于它
+    static const size_t MAX_SPILL = 64 * 1024;
+
+    response_writer() : m_len(0) {}
+
+    //开始新的响应；溢出段只清空，容量保留
+    void reset()
+    {
+        m_len = 0;
+        m_spill.clear();
+    }
+
+    bool append(std::string_view s)
+    {
+        if (m_spill.empty() && m_len + s.size() <= SIZE)
+        {
+            memcpy(m_buf + m_len, s.data(), s.size());
+            m_len += s.size();
+            return true;
+        }
+        //片段不拆开：一旦溢出，之后的内容都写入溢出段，保证顺序
+        if (m_spill.size() + s.size() > MAX_SPILL)
+            return false;
+        m_spill.append(s.data(), s.size());
+        return true;
+    }
+
+    bool append_uint(unsigned long long v)
+    {
+        char tmp[20];
+        return append(std::string_view(tmp, format_uint(tmp, v)));
+    }
+
+    bool append_date() { return append(std::string_view(http_date_line(), HTTP_DATE_LINE_LEN)); }
+
+    size_t size() const { return m_len + m_spill.size(); }
+
+    //把响应头放进 iv，返回使用的 iovec 个数(1 或 2)
+    int fill_iovec(struct iovec *iv)
+    {
+        iv[0].iov_base = m_buf;
+        iv[0].iov_len = m_len;
+        if (m_spill.empty())
+            return 1;
+        iv[1].iov_base = &m_spill[0];
+        iv[1].iov_len = m_spill.size();
+        return 2;
+    }
+
+private:
+    char m_buf[SIZE];
+    size_t m_len;
+    std::string m_spill;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*************************************************************
+*路由表：URL 按精确路径或第一段前缀(如 "/static/...")映射到处理方式，再按请求方法过滤
+*路由在编译期构造成完美哈希：构造函数尝试种子直到所有路由落在不同的槽里，路由重复或找不到种子时编译失败
+*查找最多两次哈希(整条路径、第一段)，与路由条数无关，不分配内存
+**************************************************************/
+
+#ifndef ROUTE_TABLE_H
+#define ROUTE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+//与 http_conn::METHOD 的顺序一致，按位组合
+enum route_method
+{
+    ROUTE_GET = 1 << 0,
+    ROUTE_POST = 1 << 1,
+    ROUTE_ANY = ROUTE_GET | ROUTE_POST
+};
+
+enum route_match
+{
+    ROUTE_EXACT = 0,        //整条路径相同
+    ROUTE_PREFIX            //路径的第一段相同，path 写成 "/static" 时匹配 "/static/..."
+};
+
+enum route_handler
+{
+    ROUTE_PAGE = 0,         //返回 target 指定的文件
+    ROUTE_LOGIN,            //表单登录
+    ROUTE_REGISTER,         //表单注册
+    ROUTE_REDIRECT          //302 跳转到 target
+};
+
+struct route
+{
+    std::string_view path;
+    route_match match;
+    unsigned methods;
+    route_handler handler;
+    const char *target;
+    const char *session_page;   //已登录(带有效会话)时改为返回的页面，NULL 表示不区分
+};
+
+template <size_t N>
+class route_table
+{
+public:
+    constexpr route_table(const route (&routes)[N]) : m_routes(routes), m_seed(0), m_slots()
+    {
+        for (size_t i = 0; i < N; ++i)
+            for (size_t j = i + 1; j < N; ++j)
+                if (routes[i].path == routes[j].path && routes[i].match == routes[j].match)
+                    throw "route_table: duplicate route";
+        for (uint32_t seed = 1;; ++seed)
+        {
+            if (seed > MAX_SEED)
+                throw "route_table: no perfect hash";
+            for (size_t i = 0; i < SLOTS; ++i)
+                m_slots[i] = -1;
+            bool ok = true;
+            for (size_t i = 0; ok && i < N; ++i)
+            {
+                size_t s = hash(seed, routes[i].path, routes[i].match) & (SLOTS - 1);
+                ok = m_slots[s] < 0;
+                m_slots[s] = (int8_t)i;
+            }
+            if (ok)
+            {
+                m_seed = seed;
+                return;
+            }
+        }
+    }
+
+    //method 为 1 << http_conn::METHOD，path 不含查询串；找不到或方法不允许时返回 NULL
+    const route *match(unsigned method, const char *path, size_t len) const
+    {
+        std::string_view p(path, len);
+        const route *r = lookup(p, ROUTE_EXACT);
+        if (!r && len > 1)
+        {
+            const char *slash = (const char *)memchr(path + 1, '/', len - 1);
+            if (slash)
+                r = lookup(std::string_view(path, slash - path), ROUTE_PREFIX);
+        }
+        return r && (r->methods & method) ? r : NULL;
+    }
+
+private:
+    static_assert(N > 0 && N < 128, "route count");
+    static const uint32_t MAX_SEED = 10000;
+
+    //槽数为不小于 2N 的 2 的幂，负载不超过一半，种子很快就能找到
+    static constexpr size_t slot_count()
+    {
+        size_t n = 1;
+        while (n < 2 * N)
+            n <<= 1;
+        return n;
+    }
+    static constexpr size_t SLOTS = slot_count();
+
+    //带种子的 FNV-1a，匹配方式参与哈希，同一路径可以同时有精确和前缀两种路由
+    static constexpr uint32_t hash(uint32_t seed, std::string_view s, route_match m)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : s)
+            h = (h ^ (unsigned char)c) * 16777619u;
+        h = (h ^ (uint32_t)m) * 16777619u;
+        return h ^ (h >> 15);
+    }
+
+    const route *lookup(std::string_view path, route_match m) const
+    {
+        int i = m_slots[hash(m_seed, path, m) & (SLOTS - 1)];
+        if (i < 0 || m_routes[i].match != m || m_routes[i].path != path)
+            return NULL;
+        return &m_routes[i];
+    }
+
+private:
+    const route *m_routes;
+    uint32_t m_seed;
+    int8_t m_slots[SLOTS];
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "access_log.h"
+#include "../timer/coarse_clock.h"
+using namespace std;
+
+//每个线程缓存 "[19/Oct/2026:15:55:07 +0800] "，秒数变化时才重新生成
+struct access_time_cache
+{
+    time_t m_sec = -1;          //-1 表示还没有生成过
+    char m_str[48];
+    int m_len;
+};
+static thread_local access_time_cache t_access_time;
+
+access_log::access_log()
+{
+    m_sample = 0;
+    m_fd = -1;
+}
+
+access_log::~access_log()
+{
+    stop();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool access_log::init(const char *file_name, int sample, int buf_count)
+{
+    m_fd = open(file_name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (m_fd < 0)
+        return false;
+    //写线程启动失败时每行同步写入
+    start(BUFFER_SIZE, buf_count, FLUSH_INTERVAL_MS);
+    m_sample = sample > 0 ? sample : 0;
+    return true;
+}
+
+bool access_log::sampled()
+{
+    static thread_local unsigned int t_count = 0;
+    return m_sample > 0 && t_count++ % m_sample == 0;
+}
+
+//追加字符串，引号、反斜杠和控制字符转义为 \xHH，超出 end 时截断
+static char *append_escaped(char *p, char *end, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (; *s && p < end; ++s)
+    {
+        unsigned char c = *s;
+        if (c < 0x20 || c == '"' || c == '\\' || c == 0x7f)
+        {
+            if (end - p < 4)
+                break;
+            *p++ = '\\';
+            *p++ = 'x';
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 0xf];
+        }
+        else
+            *p++ = c;
+    }
+    return p;
+}
+
+static char *append_num(char *p, long long v)
+{
+    char tmp[24];
+    int n = 0;
+    bool neg = v < 0;
+    unsigned long long u = neg ? -(unsigned long long)v : v;
+    do
+    {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (neg)
+        *p++ = '-';
+    while (n)
+        *p++ = tmp[--n];
+    return p;
+}
+
+static char *append_raw(char *p, const char *s, int len)
+{
+    memcpy(p, s, len);
+    return p + len;
+}
+
+int access_log::format(char *buf, const access_entry &e)
+{
+    access_time_cache &tc = t_access_time;
+    time_t sec = coarse_clock::now_sec();
+    if (tc.m_sec != sec)
+    {
+        struct tm my_tm;
+        localtime_r(&sec, &my_tm);
+        tc.m_len = strftime(tc.m_str, sizeof(tc.m_str), " - - [%d/%b/%Y:%H:%M:%S %z] \"", &my_tm);
+        tc.m_sec = sec;
+    }
+
+    //数字和固定部分最多占 128 字节，其余空间留给可变长的字段
+    char *p = buf;
+    char *end = buf + LINE_MAX_LEN - 128;
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &e.m_addr->sin_addr, addr, sizeof(addr));
+    p = append_raw(p, addr, strlen(addr));
+    p = append_raw(p, tc.m_str, tc.m_len);
+    p = append_raw(p, e.m_method, strlen(e.m_method));
+    *p++ = ' ';
+    p = append_escaped(p, end, e.m_url ? e.m_url : "-");
+    //只接受 HTTP/1.1 的请求
+    p = append_raw(p, " HTTP/1.1\" ", 11);
+    p = append_num(p, e.m_status);
+    *p++ = ' ';
+    p = append_num(p, e.m_bytes);
+    p = append_raw(p, " \"", 2);
+    p = append_escaped(p, end, e.m_referer ? e.m_referer : "-");
+    p = append_raw(p, "\" \"", 3);
+    p = append_escaped(p, end, e.m_user_agent ? e.m_user_agent : "-");
+    p = append_raw(p, "\" ", 2);
+    p = append_num(p, e.m_latency_us);
+    *p++ = '\n';
+    return p - buf;
+}
+
+void access_log::write(const access_entry &e)
+{
+    if (m_fd < 0)
+        return;
+    char *buf = started() ? reserve(LINE_MAX_LEN) : NULL;
+    if (buf)
+    {
+        commit(format(buf, e));
+        return;
+    }
+    //没有空闲缓冲时直接写文件，O_APPEND 下单次 write 不会与其他写入交错
+    char line[LINE_MAX_LEN];
+    int len = format(line, e);
+    ::write(m_fd, line, len);
+}
+
+//访问日志不统计行数
+void access_log::write_out(struct iovec *iov, int iovcnt, int)
+{
+    writev_all(m_fd, iov, iovcnt);
+}
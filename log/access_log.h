@@ -0,0 +1,60 @@
+/*************************************************************
+*访问日志：每个完成的响应一行，Combined Log Format，末尾附加处理耗时(微秒)
+*  127.0.0.1 - - [19/Oct/2026:15:55:07 +0800] "GET /judge.html HTTP/1.1" 200 586 "-" "curl/7.88.1" 153
+*与诊断日志 Log 相互独立，复用 buffer_sink 的每线程缓冲和批量 writev，
+*可以把 Log 调到 warn 而仍然记录全部请求
+**************************************************************/
+
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdio.h>
+#include <netinet/in.h>
+#include "buffer_sink.h"
+
+struct access_entry
+{
+    const sockaddr_in *m_addr;
+    const char *m_method;
+    const char *m_url;
+    int m_status;
+    long long m_bytes;          //发送的字节数，包括响应头
+    long long m_latency_us;     //从读到请求的第一个字节到发送完最后一个字节
+    const char *m_referer;      //没有时为 NULL，记为 "-"
+    const char *m_user_agent;
+};
+
+class access_log : public buffer_sink
+{
+public:
+    static access_log *get_instance()
+    {
+        static access_log instance;
+        return &instance;
+    }
+
+    //sample 为每 sample 个请求记录一个，buf_count 为每线程缓冲的总块数
+    bool init(const char *file_name, int sample = 1, int buf_count = 16);
+    //是否开启，未开启时请求路径上只有这一次判断
+    bool enabled() const { return m_sample > 0; }
+    //按 1/sample 抽样，每个线程单独计数
+    bool sampled();
+    void write(const access_entry &e);
+
+private:
+    access_log();
+    virtual ~access_log();
+
+    void write_out(struct iovec *iov, int iovcnt, int lines);
+    int format(char *buf, const access_entry &e);
+
+private:
+    static const int LINE_MAX_LEN = 2048;      //单行的最大长度，URL、Referer、User-Agent 超长时截断
+    static const int BUFFER_SIZE = 256 * 1024;
+    static const int FLUSH_INTERVAL_MS = 1000;
+
+    int m_sample;
+    int m_fd;                                  //O_APPEND 打开，写线程的批量写入和缓冲不足时的同步写入不会交错
+};
+
+#endif
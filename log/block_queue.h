@@ -1,6 +1,8 @@
 /*************************************************************
-*循环数组实现的阻塞队列，m_back = (m_back + 1) % m_max_size;  
+*循环数组实现的阻塞队列，m_back = (m_back + 1) % m_max_size;
 *线程安全，每个操作前都要先加互斥锁，操作完后，再解锁
+*元素按移动方式入队出队；生产者和消费者分别等待各自的条件变量，
+*只在有线程等待时才唤醒，且只唤醒一个
 **************************************************************/
 
 #ifndef BLOCK_QUEUE_H
@@ -9,7 +11,8 @@
 #include <iostream>
 #include <stdlib.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include <time.h>
+#include <utility>
 #include "../lock/locker.h"
 using namespace std;
 
@@ -30,6 +33,8 @@ public:
         m_size = 0;
         m_front = -1;
         m_back = -1;
+        m_pop_waiters = 0;
+        m_push_waiters = 0;
     }
 
     void clear()
@@ -38,6 +43,8 @@ public:
         m_size = 0;
         m_front = -1;
         m_back = -1;
+        if (m_push_waiters > 0)
+            m_not_full.broadcast();
         m_mutex.unlock();
     }
 
@@ -49,33 +56,24 @@ public:
 
         m_mutex.unlock();
     }
-    //判断队列是否满了
-    bool full() 
+    //判断队列是否满了，结果只是瞬时状态，入队请直接使用 push 的返回值
+    bool full()
     {
         m_mutex.lock();
-        if (m_size >= m_max_size)
-        {
-
-            m_mutex.unlock();
-            return true;
-        }
+        bool ret = m_size >= m_max_size;
         m_mutex.unlock();
-        return false;
+        return ret;
     }
     //判断队列是否为空
-    bool empty() 
+    bool empty()
     {
         m_mutex.lock();
-        if (0 == m_size)
-        {
-            m_mutex.unlock();
-            return true;
-        }
+        bool ret = m_size == 0;
         m_mutex.unlock();
-        return false;
+        return ret;
     }
     //返回队首元素
-    bool front(T &value) 
+    bool front(T &value)
     {
         m_mutex.lock();
         if (0 == m_size)
@@ -83,12 +81,12 @@ public:
             m_mutex.unlock();
             return false;
         }
-        value = m_array[m_front];
+        value = m_array[(m_front + 1) % m_max_size];
         m_mutex.unlock();
         return true;
     }
     //返回队尾元素
-    bool back(T &value) 
+    bool back(T &value)
     {
         m_mutex.lock();
         if (0 == m_size)
@@ -101,7 +99,7 @@ public:
         return true;
     }
 
-    int size() 
+    int size()
     {
         int tmp = 0;
 
@@ -114,101 +112,170 @@ public:
 
     int max_size()
     {
-        int tmp = 0;
-
-        m_mutex.lock();
-        tmp = m_max_size;
-
-        m_mutex.unlock();
-        return tmp;
+        return m_max_size;
     }
-    //往队列添加元素，需要将所有使用队列的线程先唤醒
-    //当有元素push进队列,相当于生产者生产了一个元素
-    //若当前没有线程等待条件变量,则唤醒无意义
+
+    //往队列添加元素，队列满时立即返回 false
     bool push(const T &item)
     {
-
+        return emplace(item);
+    }
+    bool push(T &&item)
+    {
+        return emplace(std::move(item));
+    }
+    //在队尾直接构造元素
+    template <class... Args>
+    bool emplace(Args &&...args)
+    {
         m_mutex.lock();
         if (m_size >= m_max_size)
         {
-
-            m_cond.broadcast();
             m_mutex.unlock();
             return false;
         }
-
-        m_back = (m_back + 1) % m_max_size;
-        m_array[m_back] = item;
-
-        m_size++;
-
-        m_cond.broadcast();
+        put(std::forward<Args>(args)...);
         m_mutex.unlock();
         return true;
     }
-    //pop时,如果当前队列没有元素,将会等待条件变量
-    bool pop(T &item)
+    //队列满时最多等待 ms_timeout 毫秒
+    bool push(T &&item, int ms_timeout)
     {
-
+        struct timespec t = deadline(ms_timeout);
         m_mutex.lock();
-        //多个消费者的时候，这里要是用while而不是if
-        while (m_size <= 0)
+        while (m_size >= m_max_size)
         {
-            //当重新抢到互斥锁，pthread_cond_wait返回为0
-            if (!m_cond.wait(m_mutex.get()))
+            ++m_push_waiters;
+            bool ok = m_not_full.timewait(m_mutex.get(), t);
+            --m_push_waiters;
+            if (!ok && m_size >= m_max_size)
             {
                 m_mutex.unlock();
                 return false;
             }
         }
-//取出队列首的元素，这里需要理解一下，使用循环数组模拟的队列 
-        m_front = (m_front + 1) % m_max_size;
-        item = m_array[m_front];
-        m_size--;
+        put(std::move(item));
         m_mutex.unlock();
         return true;
     }
 
-    //增加了超时处理
-    bool pop(T &item, int ms_timeout)
+    //pop时,如果当前队列没有元素,将会等待条件变量
+    bool pop(T &item)
     {
-        struct timespec t = {0, 0};
-        struct timeval now = {0, 0};
-        gettimeofday(&now, NULL);
         m_mutex.lock();
-        if (m_size <= 0)
+        //多个消费者的时候，这里要是用while而不是if
+        while (m_size <= 0)
         {
-            t.tv_sec = now.tv_sec + ms_timeout / 1000;
-            t.tv_nsec = (ms_timeout % 1000) * 1000;
-            if (!m_cond.timewait(m_mutex.get(), t))
+            ++m_pop_waiters;
+            bool ok = m_not_empty.wait(m_mutex.get());
+            --m_pop_waiters;
+            //当重新抢到互斥锁，pthread_cond_wait返回为0
+            if (!ok)
             {
                 m_mutex.unlock();
                 return false;
             }
         }
+        take(item);
+        m_mutex.unlock();
+        return true;
+    }
 
+    //不等待，队列为空时返回 false
+    bool try_pop(T &item)
+    {
+        m_mutex.lock();
         if (m_size <= 0)
         {
             m_mutex.unlock();
             return false;
         }
+        take(item);
+        m_mutex.unlock();
+        return true;
+    }
+
+    //增加了超时处理，最多等待 ms_timeout 毫秒
+    bool pop(T &item, int ms_timeout)
+    {
+        return pop_batch(&item, 1, ms_timeout) == 1;
+    }
+
+    //一次取出最多 max 个元素，队列为空时最多等待 ms_timeout 毫秒(小于 0 时一直等待)
+    //返回取出的个数，超时返回 0
+    int pop_batch(T *out, int max, int ms_timeout = -1)
+    {
+        struct timespec t = deadline(ms_timeout);
+        m_mutex.lock();
+        while (m_size <= 0)
+        {
+            ++m_pop_waiters;
+            bool ok = ms_timeout < 0 ? m_not_empty.wait(m_mutex.get()) : m_not_empty.timewait(m_mutex.get(), t);
+            --m_pop_waiters;
+            if (!ok && m_size <= 0)
+            {
+                m_mutex.unlock();
+                return 0;
+            }
+        }
+        int n = 0;
+        while (n < max && m_size > 0)
+            take(out[n++]);
+        m_mutex.unlock();
+        return n;
+    }
 
+private:
+    //以下两个函数在持有 m_mutex 时调用
+    template <class... Args>
+    void put(Args &&...args)
+    {
+        m_back = (m_back + 1) % m_max_size;
+        m_array[m_back] = T(std::forward<Args>(args)...);
+        m_size++;
+        //若当前没有线程等待条件变量,则唤醒无意义
+        if (m_pop_waiters > 0)
+            m_not_empty.signal();
+    }
+    //取出队列首的元素，使用循环数组模拟的队列
+    void take(T &item)
+    {
         m_front = (m_front + 1) % m_max_size;
-        item = m_array[m_front];
+        item = std::move(m_array[m_front]);
         m_size--;
-        m_mutex.unlock();
-        return true;
+        if (m_push_waiters > 0)
+            m_not_full.signal();
+    }
+
+    //pthread_cond_timedwait 使用 CLOCK_REALTIME 的绝对时间
+    static struct timespec deadline(int ms_timeout)
+    {
+        struct timespec t = {0, 0};
+        if (ms_timeout < 0)
+            return t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += ms_timeout / 1000;
+        t.tv_nsec += (long)(ms_timeout % 1000) * 1000000;
+        if (t.tv_nsec >= 1000000000)
+        {
+            t.tv_sec += 1;
+            t.tv_nsec -= 1000000000;
+        }
+        return t;
     }
 
 private:
     locker m_mutex;   // 已经在 构造函数里面初始化了
-    cond m_cond;
+    cond m_not_empty;
+    cond m_not_full;
 
     T *m_array;
     int m_size;
     int m_max_size;
     int m_front;
     int m_back;
+    int m_pop_waiters;      //等待出队的线程数
+    int m_push_waiters;     //等待入队的线程数
 };
 
 #endif
@@ -0,0 +1,263 @@
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include "buffer_sink.h"
+using namespace std;
+
+std::atomic<int> buffer_sink::s_sink_count(0);
+thread_local sink_slot *buffer_sink::t_slots[buffer_sink::MAX_SINKS] = {};
+
+buffer_sink::buffer_sink()
+{
+    m_id = s_sink_count++;
+    m_started = false;
+    m_stop = false;
+    m_flush_req = false;
+    m_full = NULL;
+}
+
+buffer_sink::~buffer_sink()
+{
+    stop();
+    for (size_t i = 0; i < m_all.size(); ++i)
+    {
+        delete[] m_all[i]->m_data;
+        delete m_all[i];
+    }
+    delete m_full;
+}
+
+bool buffer_sink::start(int buf_size, int buf_count, int flush_ms)
+{
+    if (m_started || m_id >= MAX_SINKS || buf_size <= 0 || buf_count <= 0)
+        return false;
+
+    //缓冲只分配不写入，页面在使用它的线程第一次写入时才分配，位于该线程所在的 NUMA 节点
+    for (int i = 0; i < buf_count; ++i)
+    {
+        log_buffer *buf = new log_buffer;
+        buf->m_data = new char[buf_size];
+        buf->m_size = buf_size;
+        buf->m_used = 0;
+        buf->m_seq = 0;
+        buf->m_slot = NULL;
+        buf->m_flushed = 0;
+        buf->m_flushed_lines = 0;
+        m_all.push_back(buf);
+        m_free.push_back(buf);
+    }
+    //所有缓冲都可能同时在队列中，再留一些位置给唤醒用的 NULL
+    m_full = new block_queue<log_buffer *>(buf_count + 8);
+    m_flush_ms = flush_ms;
+
+    if (pthread_create(&m_tid, NULL, writer_thread, this) != 0)
+        return false;
+    m_started = true;
+    return true;
+}
+
+void buffer_sink::stop()
+{
+    if (!m_started)
+        return;
+    m_started = false;
+    m_stop = true;
+    m_full->push(NULL);
+    pthread_join(m_tid, NULL);
+}
+
+bool buffer_sink::bind_cpus(const cpu_set_t *set)
+{
+    if (!m_started)
+        return false;
+    return pthread_setaffinity_np(m_tid, sizeof(cpu_set_t), set) == 0;
+}
+
+//线程第一次输出时登记，之后只访问线程局部的登记项
+//线程退出后登记项不回收，本项目中的线程都是常驻的
+sink_slot *buffer_sink::register_thread()
+{
+    sink_slot *slot = new sink_slot;
+    slot->m_cur = NULL;
+    slot->m_next_seq = 0;
+    slot->m_drained = 0;
+    m_slot_lock.lock();
+    m_slots.push_back(slot);
+    m_slot_lock.unlock();
+    t_slots[m_id] = slot;
+    return slot;
+}
+
+log_buffer *buffer_sink::take_free()
+{
+    log_buffer *buf = NULL;
+    m_free_lock.lock();
+    if (!m_free.empty())
+    {
+        buf = m_free.back();
+        m_free.pop_back();
+    }
+    m_free_lock.unlock();
+    return buf;
+}
+
+char *buffer_sink::reserve(int n)
+{
+    sink_slot *slot = t_slots[m_id];
+    if (!slot)
+        slot = register_thread();
+
+    log_buffer *cur = slot->m_cur.load(memory_order_relaxed);
+    if (cur)
+    {
+        int used = (int)(cur->m_used.load(memory_order_relaxed) & 0xffffffff);
+        if (cur->m_size - used >= n)
+            return cur->m_data + used;
+    }
+
+    //当前缓冲已满，换一块空闲缓冲(只有这里会加锁)
+    log_buffer *buf = take_free();
+    if (!buf || buf->m_size < n)
+    {
+        if (buf)
+        {
+            m_free_lock.lock();
+            m_free.push_back(buf);
+            m_free_lock.unlock();
+        }
+        return NULL;
+    }
+    buf->m_slot = slot;
+    buf->m_seq = slot->m_next_seq++;
+    slot->m_cur.store(buf, memory_order_release);
+    if (cur)
+        m_full->push(cur);
+    return buf->m_data;
+}
+
+void buffer_sink::commit(int n, int lines)
+{
+    log_buffer *cur = t_slots[m_id]->m_cur.load(memory_order_relaxed);
+    unsigned long long used = cur->m_used.load(memory_order_relaxed);
+    used += (unsigned long long)lines << 32 | (unsigned int)n;
+    cur->m_used.store(used, memory_order_release);
+}
+
+void buffer_sink::flush()
+{
+    //已有未处理的唤醒请求时不再重复入队
+    if (!m_flush_req.exchange(true))
+        m_full->push(NULL);
+}
+
+bool buffer_sink::writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t ret = writev(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        //处理部分写入
+        while (iovcnt > 0 && (size_t)ret >= iov->iov_len)
+        {
+            ret -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    return true;
+}
+
+void *buffer_sink::writer_thread(void *args)
+{
+    ((buffer_sink *)args)->writer_loop();
+    return NULL;
+}
+
+//把缓冲中尚未写出的部分加入 iov
+void buffer_sink::collect(log_buffer *buf, vector<struct iovec> &iov, int &lines)
+{
+    unsigned long long used = buf->m_used.load(memory_order_acquire);
+    int bytes = (int)(used & 0xffffffff);
+    int nlines = (int)(used >> 32);
+    if (bytes <= buf->m_flushed)
+        return;
+    struct iovec v;
+    v.iov_base = buf->m_data + buf->m_flushed;
+    v.iov_len = bytes - buf->m_flushed;
+    iov.push_back(v);
+    lines += nlines - buf->m_flushed_lines;
+    buf->m_flushed = bytes;
+    buf->m_flushed_lines = nlines;
+}
+
+void buffer_sink::writer_loop()
+{
+    vector<struct iovec> iov;
+    vector<log_buffer *> done;
+    vector<log_buffer *> batch(m_full->max_size());
+    iov.reserve(IOV_MAX);
+
+    while (true)
+    {
+        //一次取出队列中所有写满的缓冲，队列为空时最多等待 m_flush_ms
+        int n = m_full->pop_batch(&batch[0], batch.size(), m_flush_ms);
+        bool stopping = m_stop;
+        m_flush_req = false;
+        int lines = 0;
+
+        //先处理写满的缓冲(队列中同一线程的缓冲按顺序排列)，NULL 只用于唤醒
+        for (int i = 0; i < n; ++i)
+        {
+            log_buffer *buf = batch[i];
+            if (buf)
+            {
+                collect(buf, iov, lines);
+                buf->m_slot->m_drained = buf->m_seq + 1;
+                done.push_back(buf);
+            }
+        }
+
+        //再收集各线程当前缓冲中已提交的部分
+        //若该线程之前的缓冲还没有出队，说明它刚刚换过缓冲，留到下一轮以免顺序颠倒
+        m_slot_lock.lock();
+        for (list<sink_slot *>::iterator it = m_slots.begin(); it != m_slots.end(); ++it)
+        {
+            log_buffer *cur = (*it)->m_cur.load(memory_order_acquire);
+            if (cur && cur->m_seq == (*it)->m_drained)
+                collect(cur, iov, lines);
+        }
+        m_slot_lock.unlock();
+
+        if (!iov.empty())
+            write_out(&iov[0], iov.size(), lines);
+        iov.clear();
+
+        //写完的缓冲放回空闲列表
+        if (!done.empty())
+        {
+            m_free_lock.lock();
+            for (size_t i = 0; i < done.size(); ++i)
+            {
+                done[i]->m_used.store(0, memory_order_relaxed);
+                done[i]->m_flushed = 0;
+                done[i]->m_flushed_lines = 0;
+                m_free.push_back(done[i]);
+            }
+            m_free_lock.unlock();
+            done.clear();
+        }
+
+        if (stopping)
+            break;
+    }
+}
@@ -0,0 +1,93 @@
+/*************************************************************
+*每线程缓冲 + 单个写线程的异步输出
+*各线程只向自己的缓冲追加数据，追加不加锁、不分配内存；
+*缓冲写满时换一块空闲缓冲，写满的交给写线程，
+*写线程定期把所有缓冲中已提交的数据用一次 writev 写出
+**************************************************************/
+
+#ifndef BUFFER_SINK_H
+#define BUFFER_SINK_H
+
+#include <atomic>
+#include <list>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include "block_queue.h"
+#include "../lock/locker.h"
+
+struct sink_slot;
+
+struct log_buffer
+{
+    char *m_data;
+    int m_size;
+    //低 32 位为已提交的字节数，高 32 位为已提交的行数，一次原子写同时发布两者
+    std::atomic<unsigned long long> m_used;
+    unsigned long long m_seq;   //在所属线程中是第几块缓冲，由写线程用来保证同一线程的数据按序写出
+    sink_slot *m_slot;
+    int m_flushed;              //以下两项只由写线程访问：已写出的字节数和行数
+    int m_flushed_lines;
+};
+
+//每个线程在每个 sink 中的登记项
+struct sink_slot
+{
+    std::atomic<log_buffer *> m_cur;  //线程当前的缓冲
+    unsigned long long m_next_seq;    //只由所属线程访问
+    unsigned long long m_drained;     //只由写线程访问：已经写完的缓冲数
+};
+
+class buffer_sink
+{
+public:
+    buffer_sink();
+    virtual ~buffer_sink();
+
+    //buf_size 每块缓冲大小，buf_count 预分配的缓冲块数，flush_ms 写线程最长的写出间隔
+    bool start(int buf_size, int buf_count, int flush_ms);
+    void stop();
+
+    //在当前线程的缓冲中预留 n 字节，空间不足时换一块空闲缓冲；没有空闲缓冲时返回 NULL，由调用者同步写出
+    char *reserve(int n);
+    //提交最近一次 reserve 得到的空间中实际写入的 n 字节
+    void commit(int n, int lines = 1);
+    //唤醒写线程，尽快写出已提交的数据
+    void flush();
+    bool bind_cpus(const cpu_set_t *set);
+    bool started() { return m_started; }
+
+protected:
+    //在写线程中调用，iov 中的数据按各线程的提交顺序排列，lines 为其中的行数
+    virtual void write_out(struct iovec *iov, int iovcnt, int lines) = 0;
+    //writev 直到全部写完，每次最多 IOV_MAX 项，处理 EINTR 和部分写入，会修改 iov
+    static bool writev_all(int fd, struct iovec *iov, int iovcnt);
+
+private:
+    static void *writer_thread(void *args);
+    void writer_loop();
+    sink_slot *register_thread();
+    log_buffer *take_free();
+    void collect(log_buffer *buf, std::vector<struct iovec> &iov, int &lines);
+
+private:
+    static const int MAX_SINKS = 4;
+    static std::atomic<int> s_sink_count;
+    static thread_local sink_slot *t_slots[MAX_SINKS];   //当前线程在各个 sink 中的登记项
+
+    int m_id;                          //本 sink 在 t_slots 中的下标
+    bool m_started;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_flush_req;
+    int m_flush_ms;
+    pthread_t m_tid;
+    block_queue<log_buffer *> *m_full; //写满的缓冲，NULL 用于唤醒写线程
+    locker m_free_lock;
+    std::vector<log_buffer *> m_free;  //空闲缓冲
+    std::vector<log_buffer *> m_all;
+    locker m_slot_lock;
+    std::list<sink_slot *> m_slots;    //所有登记过的线程
+};
+
+#endif
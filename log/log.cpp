@@ -3,47 +3,118 @@
 #include <sys/time.h>
 #include <stdarg.h>
 #include "log.h"
+#include "../timer/coarse_clock.h"
 #include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <algorithm>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 using namespace std;
 
+extern char **environ;
+
+//每个线程缓存的时间前缀 "YYYY-MM-DD HH:MM:SS."，秒数变化时才重新调用 localtime_r
+//localtime_r 内部要获取 glibc 的时区锁，缓存后所有线程每秒各只调用一次
+struct log_time_cache
+{
+    time_t m_sec = -1;          //-1 表示还没有生成过
+    struct tm m_tm;
+    char m_prefix[32];
+    int m_len;
+};
+static thread_local log_time_cache t_time_cache;
+
+static const log_time_cache &cached_time(time_t sec)
+{
+    log_time_cache &tc = t_time_cache;
+    if (tc.m_sec != sec)
+    {
+        localtime_r(&sec, &tc.m_tm);
+        tc.m_len = snprintf(tc.m_prefix, sizeof(tc.m_prefix), "%d-%02d-%02d %02d:%02d:%02d.",
+                            tc.m_tm.tm_year + 1900, tc.m_tm.tm_mon + 1, tc.m_tm.tm_mday,
+                            tc.m_tm.tm_hour, tc.m_tm.tm_min, tc.m_tm.tm_sec);
+        tc.m_sec = sec;
+    }
+    return tc;
+}
+
+//日志分级，长度与前缀一起拼接，不再格式化
+static const char *level_str[] = {"[debug]: ", "[info]: ", "[warn]: ", "[erro]: "};
+static const int level_len[] = {9, 8, 8, 8};
+
+std::atomic<int> Log::m_level(1);
+Log::log_format_info Log::m_formats[Log::MAX_FORMATS];
+std::atomic<int> Log::m_format_count(0);
+locker Log::m_format_lock;
+
 Log::Log()
 {
-    m_count = 0;
+    m_last_flush = 0;
+    m_file_lines = 0;
+    m_split_index = 0;
     m_is_async = false;  // 默认是 同步日志
+    m_is_binary = false;
+    m_formats_written = 0;
+    m_fp = NULL;
+    m_path[0] = '\0';
+    m_compress = false;
+    m_keep_days = 0;
+    m_keep_bytes = 0;
+    m_next_fd = -1;
+    m_tasks = NULL;
+    m_hk_started = false;
 }
 
 Log::~Log()
 {
+    //先停止写线程，把各线程缓冲中剩余的日志写完
+    stop();
+    //整理线程处理完队列中已有的任务后退出
+    if (m_hk_started)
+    {
+        log_task task;
+        task.m_kind = TASK_STOP;
+        while (!m_tasks->push(std::move(task), 100))
+            ;
+        pthread_join(m_hk_tid, NULL);
+    }
+    delete m_tasks;
+    if (m_next_fd >= 0)
+        close(m_next_fd);
     if (m_fp != NULL)
     {
         fclose(m_fp);
     }
 }
-//异步需要设置阻塞队列的长度，同步不需要设置
-bool Log::init(const char *file_name, int log_buf_size, int split_lines, int max_queue_size)
-{
-    //如果设置了max_queue_size,则设置为异步
-    if (max_queue_size >= 1)
-    {
-        m_is_async = true;
-        //创建并设置阻塞队列长度
-        m_log_queue = new block_queue<string>(max_queue_size);
-        pthread_t tid;
-
-        //创建线程异步写日志   flush_log_thread为回调函数
-        pthread_create(&tid, NULL, flush_log_thread, NULL);
-    }
 
+void Log::set_retention(bool compress, int keep_days, long long keep_bytes)
+{
+    m_compress = compress;
+    m_keep_days = keep_days > 0 ? keep_days : 0;
+    m_keep_bytes = keep_bytes > 0 ? keep_bytes : 0;
+}
+//异步需要设置缓冲块数，同步不需要设置
+bool Log::init(const char *file_name, int log_buf_size, int split_lines, int max_queue_size, bool binary)
+{
     m_log_buf_size = log_buf_size;
-    m_buf = new char[m_log_buf_size];
-    memset(m_buf, '\0', m_log_buf_size);
+    m_is_binary = binary;
+    //二进制记录中定长部分最多 LOG_RECORD_HEAD + LOG_MAX_ARGS * 8 字节
+    if (binary && m_log_buf_size < 512)
+        m_log_buf_size = 512;
 
     //日志的最大行数
     m_split_lines = split_lines;
 
-    time_t t = time(NULL);
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+    time_t t = coarse_clock::now_sec();
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
 
     //从后往前找到第一个/的位置
     const char *p = strrchr(file_name, '/');
@@ -51,125 +122,538 @@ bool Log::init(const char *file_name, int log_buf_size, int split_lines, int max
 
     //相当于自定义日志名
     //若输入的文件名没有/，则直接将时间+文件名作为日志名
+    //切分文件时也要用到 dir_name 和 log_name，两种情况都要设置
     if (p == NULL)
     {
-        snprintf(log_full_name, 255, "%d_%02d_%02d_%s", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, file_name);
+        dir_name[0] = '\0';
+        snprintf(log_name, sizeof(log_name), "%s", file_name);
     }
     else
     {
-        strcpy(log_name, p + 1);
-        strncpy(dir_name, file_name, p - file_name + 1);
-        snprintf(log_full_name, 255, "%s%d_%02d_%02d_%s", dir_name, my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, log_name);
+        snprintf(log_name, sizeof(log_name), "%s", p + 1);
+        snprintf(dir_name, sizeof(dir_name), "%.*s", (int)(p - file_name + 1), file_name);
     }
+    //二进制日志不能直接阅读，用后缀区分
+    if (binary)
+        strncat(log_name, ".bin", sizeof(log_name) - strlen(log_name) - 1);
+    snprintf(log_full_name, 255, "%s%d_%02d_%02d_%s", dir_name, my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, log_name);
 
     m_today = my_tm.tm_mday;
 
-    m_fp = fopen(log_full_name, "a");
-    if (m_fp == NULL)
+    if (!open_file(log_full_name))
     {
         return false;
     }
 
+    //整理线程启动失败时，切分文件在原线程中直接关闭
+    m_tasks = new block_queue<log_task>(64);
+    if (pthread_create(&m_hk_tid, NULL, housekeeper_thread, this) == 0)
+    {
+        m_hk_started = true;
+        prepare_next();
+    }
+
+    //如果设置了max_queue_size,则设置为异步
+    if (max_queue_size >= 1)
+    {
+        //创建写线程，每块缓冲至少能放下一行
+        int buf_size = ASYNC_BUFFER_SIZE > log_buf_size ? ASYNC_BUFFER_SIZE : log_buf_size;
+        m_is_async = start(buf_size, max_queue_size, FLUSH_INTERVAL_MS);
+    }
+
     return true;
 }
 
-void Log::write_log(int level, const char *format, ...)
+//跨天时打开当天的日志，否则在当天的文件名后加切分序号
+void Log::switch_file(const struct tm &my_tm)
 {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, NULL);
-    time_t t = now.tv_sec;
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
-    char s[16] = {0};
-
-    //日志分级
-    switch (level)
-    {
-    case 0:
-        strcpy(s, "[debug]:");
-        break;
-    case 1:
-        strcpy(s, "[info]:");
-        break;
-    case 2:
-        strcpy(s, "[warn]:");
-        break;
-    case 3:
-        strcpy(s, "[erro]:");
-        break;
-    default:
-        strcpy(s, "[info]:");
-        break;
+    char new_log[256] = {0};
+    char tail[16] = {0};
+
+//C库函数 int snprintf(char *str, size_t size, const char *format, ...)
+//设将可变参数(...)按照 format 格式化成字符串，并将字符串复制到 str 中，size 为要写入的字符的最大数目，超过 size 会被截断。
+    snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
+
+    //如果是时间不是今天,则创建今天的日志，更新m_today和切分序号
+    int index = 0;
+    if (m_today != my_tm.tm_mday)
+        snprintf(new_log, 255, "%s%s%s", dir_name, tail, log_name);
+    else
+    {
+        //超过了最大行，在之前的日志名基础上加后缀
+        index = m_split_index + 1;
+        snprintf(new_log, 255, "%s%s%s.%d", dir_name, tail, log_name, index);
     }
-    m_mutex.lock();
-    //更新现有行数
-    m_count++;
 
-    //日志不是今天或写入的日志行数是最大行的倍数
-    //m_split_lines为最大行数
-    if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0) //everyday log
+    FILE *old_fp = m_fp;
+    log_task task;
+    task.m_kind = TASK_CLOSE;
+    task.m_fp = old_fp;
+    snprintf(task.m_path, sizeof(task.m_path), "%s", m_path);
+    fflush(old_fp);
+    //新文件打不开时继续写旧文件
+    if (!open_file(new_log))
     {
-        
-        char new_log[256] = {0};
-        fflush(m_fp);
-        fclose(m_fp);
-        char tail[16] = {0};
-       
-//C库函数 int snprintf(char *str, size_t size, const char *format, ...) 
-//设将可变参数(...)按照 format 格式化成字符串，并将字符串复制到 str 中，size 为要写入的字符的最大数目，超过 size 会被截断。
-        snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
-       
-        //如果是时间不是今天,则创建今天的日志，更新m_today和m_count
-        if (m_today != my_tm.tm_mday)
+        m_fp = old_fp;
+        return;
+    }
+    m_today = my_tm.tm_mday;
+    m_split_index = index;
+    m_file_lines = 0;
+
+    //关闭(可能很慢)、压缩和清理都交给整理线程
+    if (!m_hk_started || !m_tasks->push(std::move(task)))
+        fclose(old_fp);
+    prepare_next();
+}
+
+//打开日志文件并加大 stdio 缓冲，同步模式下按大小和时间刷新，而不是每行一次
+//有预先创建的匿名文件时只需把它链接到文件名上，不在写入路径上创建文件
+bool Log::open_file(const char *path)
+{
+    FILE *fp = NULL;
+    int fd = m_next_fd.exchange(-1);
+    if (fd >= 0)
+    {
+        char proc[64];
+        snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd);
+        if (linkat(AT_FDCWD, proc, AT_FDCWD, path, AT_SYMLINK_FOLLOW) == 0)
+            fp = fdopen(fd, "a");
+        //同名文件已存在(如当天重启)时追加到该文件，匿名文件留给下次使用
+        if (fp == NULL)
         {
-            snprintf(new_log, 255, "%s%s%s", dir_name, tail, log_name);
-            m_today = my_tm.tm_mday;
-            m_count = 0;
+            int expected = -1;
+            if (!m_next_fd.compare_exchange_strong(expected, fd))
+                close(fd);
         }
-        else
+    }
+    if (fp == NULL)
+        fp = fopen(path, "a");
+    if (fp == NULL)
+        return false;
+
+    m_fp = fp;
+    snprintf(m_path, sizeof(m_path), "%s", path);
+    setvbuf(m_fp, NULL, _IOFBF, STDIO_BUFFER_SIZE);
+    //二进制文件以文件头开始，之后重新写出格式定义
+    if (m_is_binary)
+    {
+        fwrite(LOG_BIN_MAGIC, 1, sizeof(LOG_BIN_MAGIC), m_fp);
+        m_formats_written = 0;
+    }
+    return true;
+}
+
+//文本日志每行以换行结束；二进制日志每条记录以记录长度开头，一条记录算一行
+//同一行(记录)不会跨越两块缓冲，所以不会跨越两个 iov
+bool Log::find_line_end(const struct iovec *iov, int iovcnt, int lines, int *idx, size_t *off)
+{
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        const char *base = (const char *)iov[i].iov_base;
+        size_t pos = 0;
+        while (pos < iov[i].iov_len && lines > 0)
         {
-            //超过了最大行，在之前的日志名基础上加后缀, m_count/m_split_lines
-            snprintf(new_log, 255, "%s%s%s.%lld", dir_name, tail, log_name, m_count / m_split_lines);
+            if (m_is_binary)
+            {
+                uint32_t len;
+                memcpy(&len, base + pos, 4);
+                pos += len;
+            }
+            else
+            {
+                const char *nl = (const char *)memchr(base + pos, '\n', iov[i].iov_len - pos);
+                if (nl == NULL)
+                    break;
+                pos = nl - base + 1;
+            }
+            --lines;
         }
-        m_fp = fopen(new_log, "a");
+        if (lines == 0)
+        {
+            *idx = i;
+            *off = pos;
+            return true;
+        }
+    }
+    return false;
+}
+
+void *Log::housekeeper_thread(void *args)
+{
+    //整理线程以最低优先级运行，gzip 子进程继承该优先级
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    ((Log *)args)->housekeeper_loop();
+    return NULL;
+}
+
+void Log::housekeeper_loop()
+{
+    log_task task;
+    while (m_tasks->pop(task))
+    {
+        if (task.m_kind == TASK_STOP)
+            break;
+        if (task.m_kind == TASK_PREPARE)
+        {
+            //O_TMPFILE 创建的文件没有名字，切换时用 linkat 赋予文件名；不支持时切换时直接 fopen
+            if (m_next_fd.load() < 0)
+            {
+                int fd = open(dir_name[0] ? dir_name : ".", O_TMPFILE | O_WRONLY, 0644);
+                int expected = -1;
+                if (fd >= 0 && !m_next_fd.compare_exchange_strong(expected, fd))
+                    close(fd);
+            }
+            continue;
+        }
+        fclose(task.m_fp);
+        //先清理再压缩，已被清理掉的文件不再压缩
+        enforce_retention();
+        if (m_compress && access(task.m_path, F_OK) == 0)
+            compress(task.m_path);
     }
- 
+}
+
+void Log::prepare_next()
+{
+    if (!m_hk_started)
+        return;
+    log_task task;
+    task.m_kind = TASK_PREPARE;
+    m_tasks->push(std::move(task));
+}
+
+//调用 gzip 压缩，gzip 不存在时保留原文件
+void Log::compress(const char *path)
+{
+    char *argv[] = {(char *)"gzip", (char *)"-f", (char *)path, NULL};
+    pid_t pid;
+    if (posix_spawnp(&pid, "gzip", NULL, NULL, argv, environ) != 0)
+        return;
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+}
+
+struct log_file_info
+{
+    string m_path;
+    time_t m_mtime;
+    long long m_size;
+};
+
+static bool older_first(const log_file_info &a, const log_file_info &b)
+{
+    return a.m_mtime < b.m_mtime;
+}
+
+//按 "YYYY_MM_DD_日志名[.序号][.gz]" 找出本日志的所有文件，当前文件不删除
+void Log::enforce_retention()
+{
+    if (m_keep_days == 0 && m_keep_bytes == 0)
+        return;
+    const char *dir = dir_name[0] ? dir_name : "./";
+    DIR *dp = opendir(dir);
+    if (dp == NULL)
+        return;
+
+    m_mutex.lock();
+    string current = m_path;
     m_mutex.unlock();
 
+    vector<log_file_info> files;
+    long long total = 0;
+    size_t name_len = strlen(log_name);
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL)
+    {
+        int y, mon, d, n = 0;
+        if (sscanf(ent->d_name, "%4d_%2d_%2d_%n", &y, &mon, &d, &n) != 3 || n != 11)
+            continue;
+        const char *rest = ent->d_name + n;
+        if (strncmp(rest, log_name, name_len) != 0 || (rest[name_len] != '\0' && rest[name_len] != '.'))
+            continue;
+        log_file_info info;
+        info.m_path = string(dir) + ent->d_name;
+        struct stat st;
+        if (stat(info.m_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        total += st.st_size;
+        if (info.m_path == current)
+            continue;
+        info.m_mtime = st.st_mtime;
+        info.m_size = st.st_size;
+        files.push_back(info);
+    }
+    closedir(dp);
+
+    sort(files.begin(), files.end(), older_first);
+    time_t expire = coarse_clock::now_sec() - (time_t)m_keep_days * 86400;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        bool too_old = m_keep_days > 0 && files[i].m_mtime < expire;
+        bool too_big = m_keep_bytes > 0 && total > m_keep_bytes;
+        if (!too_old && !too_big)
+            break;
+        if (unlink(files[i].m_path.c_str()) == 0)
+            total -= files[i].m_size;
+    }
+}
+
+int Log::register_format(int level, const char *format)
+{
+    m_format_lock.lock();
+    int id = m_format_count.load(memory_order_relaxed);
+    if (id >= MAX_FORMATS)
+    {
+        m_format_lock.unlock();
+        return -1;
+    }
+
+    log_format_info &f = m_formats[id];
+    f.m_level = level;
+    f.m_nargs = 0;
+    f.m_fixed = LOG_RECORD_HEAD;
+    log_conv c;
+    const char *p = format;
+    int ret;
+    while ((ret = log_next_conv(p, &c)) > 0 && f.m_nargs + c.m_nargs <= LOG_MAX_ARGS)
+    {
+        for (int i = 0; i < c.m_nargs; ++i)
+        {
+            f.m_args[f.m_nargs++] = c.m_args[i];
+            f.m_fixed += c.m_args[i] == LOG_ARG_INT ? 4 : (c.m_args[i] == LOG_ARG_STR ? 2 : 8);
+        }
+        p = c.m_end;
+    }
+    //无法解析的格式串不登记，这些调用点按文本记录
+    if (ret != 0)
+    {
+        m_format_lock.unlock();
+        return -1;
+    }
+    f.m_format = strdup(format);
+    m_format_count.store(id + 1, memory_order_release);
+    m_format_lock.unlock();
+    return id;
+}
+
+//在 m_mutex 内调用
+void Log::write_formats()
+{
+    int count = m_format_count.load(memory_order_acquire);
+    for (; m_formats_written < count; ++m_formats_written)
+    {
+        const log_format_info &f = m_formats[m_formats_written];
+        uint32_t len = strlen(f.m_format);
+        uint32_t head[3] = {13 + len, LOG_BIN_DEFINE, (uint32_t)m_formats_written};
+        unsigned char level = f.m_level;
+        fwrite(head, 1, sizeof(head), m_fp);
+        fwrite(&level, 1, 1, m_fp);
+        fwrite(f.m_format, 1, len, m_fp);
+    }
+}
+
+void Log::write_log(int level, int fmt_id, const char *format, ...)
+{
+    struct timeval now = {0, 0};
+    coarse_clock::precise_now(&now);
+    const log_time_cache &tc = cached_time(now.tv_sec);
+    if (level < 0 || level > 3)
+        level = 1;
+
+    //异步时直接写到本线程的缓冲中；没有空闲缓冲时和同步一样直接写文件
+    char *buf = m_is_async ? reserve(m_log_buf_size) : NULL;
+    bool in_sink = buf != NULL;
+    if (!in_sink)
+    {
+        static thread_local char *t_line = NULL;
+        if (!t_line)
+            t_line = new char[m_log_buf_size];
+        buf = t_line;
+    }
+
 // VA_LIST 是在C语言中解决变参问题的一组宏，用于获取不确定个数的参数。
     va_list valst;
     va_start(valst, format);         //VA_START宏，获取可变参数列表的第一个参数的地址
+    int len = m_is_binary ? format_binary(buf, level, fmt_id, now, format, valst)
+                          : format_text(buf, level, now, format, valst);
+    va_end(valst);           // VA_END宏，清空va_list可变参数列表
 
-    string log_str;
+    if (in_sink)
+    {
+        commit(len);
+        return;
+    }
     m_mutex.lock();
+    //同步写入时在写入的线程中切分，异步时由写线程切分
+    if (m_today != tc.m_tm.tm_mday || m_file_lines >= m_split_lines)
+        switch_file(tc.m_tm);
+    if (m_is_binary)
+        write_formats();
+    fwrite(buf, 1, len, m_fp);
+    ++m_file_lines;
+    //缓冲写满时 stdio 自动写出；此外每秒刷新一次，warn 及以上立即刷新，避免崩溃时丢失
+    if (level >= 2 || now.tv_sec != m_last_flush)
+    {
+        fflush(m_fp);
+        m_last_flush = now.tv_sec;
+    }
+    m_mutex.unlock();
+}
 
-    //写入内容格式：时间 + 内容
-    //时间格式化，snprintf成功返回写字符的总数，其中不包括结尾的null字符
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
-    
-    //将可变参数格式化输出到一个字符数组。
-    int m = vsnprintf(m_buf + n, m_log_buf_size - 1, format, valst);
-    m_buf[n + m] = '\n';
-    m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
+//写入内容格式：时间 + 级别 + 内容，返回写入的长度(含换行)
+int Log::format_text(char *buf, int level, const struct timeval &now, const char *format, va_list ap)
+{
+    //时间前缀直接拷贝，只拼接微秒和级别
+    const log_time_cache &tc = cached_time(now.tv_sec);
+    memcpy(buf, tc.m_prefix, tc.m_len);
+    int n = tc.m_len;
+    long usec = now.tv_usec;
+    for (int i = 5; i >= 0; --i)
+    {
+        buf[n + i] = '0' + usec % 10;
+        usec /= 10;
+    }
+    n += 6;
+    buf[n++] = ' ';
+    memcpy(buf + n, level_str[level], level_len[level]);
+    n += level_len[level];
 
-    m_mutex.unlock();
+    //将可变参数格式化输出到一个字符数组，超长时截断，留出换行和结尾的位置
+    int m = vsnprintf(buf + n, m_log_buf_size - n - 1, format, ap);
+    if (m > m_log_buf_size - n - 2)
+        m = m_log_buf_size - n - 2;
+    buf[n + m] = '\n';
+    buf[n + m + 1] = '\0';
+    return n + m + 1;
+}
 
-//若异步,则将日志信息加入阻塞队列,同步则加锁向文件中写
-    if (m_is_async && !m_log_queue->full())
+//二进制记录：不格式化，只按登记时解析出的类型依次拷贝参数，字符串超长时截断
+int Log::format_binary(char *buf, int level, int fmt_id, const struct timeval &now, const char *format, va_list ap)
+{
+    uint32_t id = fmt_id;
+    long long usec = (long long)now.tv_sec * 1000000 + now.tv_usec;
+    int n = LOG_RECORD_HEAD;
+
+    if (fmt_id < 0)
     {
-        m_log_queue->push(log_str);
+        buf[n++] = level;
+        int m = vsnprintf(buf + n, m_log_buf_size - n, format, ap);
+        n += m < m_log_buf_size - n ? m : m_log_buf_size - n - 1;
+        id = LOG_BIN_TEXT;
     }
     else
     {
-        m_mutex.lock();
-        fputs(log_str.c_str(), m_fp);
-        m_mutex.unlock();
+        const log_format_info &f = m_formats[fmt_id];
+        int room = m_log_buf_size - f.m_fixed;   //所有字符串共用的空间
+        for (int i = 0; i < f.m_nargs; ++i)
+        {
+            switch (f.m_args[i])
+            {
+            case LOG_ARG_INT:
+            {
+                int v = va_arg(ap, int);
+                memcpy(buf + n, &v, 4);
+                n += 4;
+                break;
+            }
+            case LOG_ARG_LONG:
+            case LOG_ARG_LLONG:
+            {
+                long long v = f.m_args[i] == LOG_ARG_LONG ? va_arg(ap, long) : va_arg(ap, long long);
+                memcpy(buf + n, &v, 8);
+                n += 8;
+                break;
+            }
+            case LOG_ARG_DOUBLE:
+            case LOG_ARG_LDOUBLE:
+            {
+                double v = f.m_args[i] == LOG_ARG_DOUBLE ? va_arg(ap, double) : (double)va_arg(ap, long double);
+                memcpy(buf + n, &v, 8);
+                n += 8;
+                break;
+            }
+            case LOG_ARG_PTR:
+            {
+                unsigned long long v = (uintptr_t)va_arg(ap, void *);
+                memcpy(buf + n, &v, 8);
+                n += 8;
+                break;
+            }
+            case LOG_ARG_STR:
+            {
+                const char *s = va_arg(ap, const char *);
+                if (s == NULL)
+                    s = "(null)";
+                uint16_t len = strnlen(s, room > 0xffff ? 0xffff : (room > 0 ? room : 0));
+                memcpy(buf + n, &len, 2);
+                memcpy(buf + n + 2, s, len);
+                n += 2 + len;
+                room -= len;
+                break;
+            }
+            }
+        }
     }
 
-    va_end(valst);           // VA_END宏，清空va_list可变参数列表
+    uint32_t len = n;
+    memcpy(buf, &len, 4);
+    memcpy(buf + 4, &id, 4);
+    memcpy(buf + 8, &usec, 8);
+    return n;
+}
+
+//写线程调用：一次 writev 写出多个线程缓冲中的日志
+//跨天时整批写入新文件；到达切分行数时在行的边界处把这一批分到两个文件中
+void Log::write_out(struct iovec *iov, int iovcnt, int lines)
+{
+    static time_t s_sec = -1;   //只有写线程访问
+    static struct tm s_tm;
+    time_t sec = coarse_clock::now_sec();
+    if (sec != s_sec)
+    {
+        localtime_r(&sec, &s_tm);
+        s_sec = sec;
+    }
+
+    m_mutex.lock();
+    if (m_today != s_tm.tm_mday)
+        switch_file(s_tm);
+    while (lines > 0 && m_file_lines + lines > m_split_lines)
+    {
+        //当前文件已满(缓冲不足时同步写入的行可能使它超出)
+        if (m_file_lines >= m_split_lines)
+        {
+            switch_file(s_tm);
+            continue;
+        }
+        int idx;
+        size_t off;
+        if (!find_line_end(iov, iovcnt, m_split_lines - m_file_lines, &idx, &off))
+            break;
+        //新文件或新登记的格式，先写出格式定义
+        if (m_is_binary)
+            write_formats();
+        //同步写入(缓冲不足时)可能还留在 stdio 缓冲中，先写出以保持顺序
+        fflush(m_fp);
+        struct iovec rest = {(char *)iov[idx].iov_base + off, iov[idx].iov_len - off};
+        iov[idx].iov_len = off;
+        writev_all(fileno(m_fp), iov, idx + 1);
+        iov[idx] = rest;
+        iov += idx;
+        iovcnt -= idx;
+        lines -= m_split_lines - m_file_lines;
+        m_file_lines = m_split_lines;
+        switch_file(s_tm);
+    }
+
+    if (m_is_binary)
+        write_formats();
+    fflush(m_fp);
+    writev_all(fileno(m_fp), iov, iovcnt);
+    m_file_lines += lines;
+    m_mutex.unlock();
 }
 
 // 在使用多个输出函数连续进行多次输出到控制台时，有可能下一个数据再上一个数据还没输出完毕，还在输出缓冲区中时，下一个printf就把另一个数据加入输出缓冲区，结果冲掉了原来的数据，出现输出错误。
@@ -177,6 +661,12 @@ void Log::write_log(int level, const char *format, ...)
 
 void Log::flush(void)
 {
+    //异步时唤醒写线程
+    if (m_is_async)
+    {
+        buffer_sink::flush();
+        return;
+    }
     m_mutex.lock();
     //强制刷新写入流缓冲区
     fflush(m_fp);
@@ -6,11 +6,14 @@
 #include <string>
 #include <stdarg.h>
 #include <pthread.h>
-#include "block_queue.h"
+#include <sched.h>
+#include <atomic>
+#include "buffer_sink.h"
+#include "log_format.h"
 
 using namespace std;
 
-class Log
+class Log : public buffer_sink
 {
 public:
     //C++11以后,使用局部变量懒汉不用加锁
@@ -20,56 +23,128 @@ public:
         return &instance;
     }
 
-    //异步写日志公有方法，调用私有方法  async_write_log
-    static void *flush_log_thread(void *args)
-    {
-        Log::get_instance()->async_write_log();
-    }
-
-    //可选择的参数有日志文件、日志缓冲区大小、最大行数以及最长日志条队列
-    bool init(const char *file_name, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0);
-    //将输出内容按照标准格式整理
-    void write_log(int level, const char *format, ...);
+    //可选择的参数有日志文件、日志缓冲区大小、最大行数以及异步模式下的缓冲块数
+    //max_queue_size>=1 时为异步：每个线程写入自己的缓冲，写满后交给写线程批量写出
+    //binary 为 true 时只记录格式id、时间和原始参数，文件名加 .bin 后缀，用 log_decode 转成文本
+    bool init(const char *file_name, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0, bool binary = false);
+    //切分后的旧文件：compress 为 true 时用 gzip 压缩，只保留 keep_days 天以内、总大小不超过 keep_bytes 的文件(0 为不限制)
+    //需在 init 之前调用，这些工作都在低优先级的整理线程中完成
+    void set_retention(bool compress, int keep_days, long long keep_bytes);
+    //将输出内容按照标准格式整理，fmt_id 为 register_format 的返回值
+    void write_log(int level, int fmt_id, const char *format, ...);
+    //登记格式串并解析其参数类型，返回格式id；每个调用点只在第一次执行时登记一次
+    static int register_format(int level, const char *format);
     //强制刷新缓冲区
     void flush(void);
 
+    //运行期的最低日志级别：0 debug，1 info，2 warn，3 error
+    static int get_level() { return m_level.load(memory_order_relaxed); }
+    static void set_level(int level) { m_level.store(level < 0 ? 0 : (level > 3 ? 3 : level), memory_order_relaxed); }
+
 private:
     Log();
     virtual ~Log();
 
-    //异步写日志方法
-    void *async_write_log()
-    {
-        string single_log;
-
-        //从阻塞队列中取出一个日志string，写入文件
-        while (m_log_queue->pop(single_log))
-        {
-            m_mutex.lock();
-            fputs(single_log.c_str(), m_fp);
-            m_mutex.unlock();
-        }
-    }
+    //写线程批量写出各线程缓冲中的日志，跨天或到达切分行数时在写线程中切换文件
+    void write_out(struct iovec *iov, int iovcnt, int lines);
+    //以下三个函数在 m_mutex 内调用
+    //按天或按行数切换到下一个文件，旧文件交给整理线程关闭
+    void switch_file(const struct tm &my_tm);
+    bool open_file(const char *path);
+    //iov 中前 lines 行的结束位置
+    bool find_line_end(const struct iovec *iov, int iovcnt, int lines, int *idx, size_t *off);
+
+    //整理线程：预先创建下一个文件，关闭、压缩旧文件，按天数和总大小清理
+    static void *housekeeper_thread(void *args);
+    void housekeeper_loop();
+    void prepare_next();
+    void compress(const char *path);
+    void enforce_retention();
+    int format_text(char *buf, int level, const struct timeval &now, const char *format, va_list ap);
+    int format_binary(char *buf, int level, int fmt_id, const struct timeval &now, const char *format, va_list ap);
+    //二进制模式下把当前文件中还没有的格式定义写出
+    void write_formats();
 
 private:
+    static const int ASYNC_BUFFER_SIZE = 256 * 1024;   //异步模式下每块缓冲的大小
+    static const int FLUSH_INTERVAL_MS = 1000;         //写线程最长的写出间隔
+    static const int STDIO_BUFFER_SIZE = 64 * 1024;    //同步模式下 stdio 缓冲写满才写文件
+    static const int MAX_FORMATS = 4096;               //格式表大小，超出的调用点按文本记录
+    static std::atomic<int> m_level;
+
+    //二进制模式的格式表，只增不删，登记时加锁，读取不加锁
+    struct log_format_info
+    {
+        char *m_format;
+        int m_level;
+        int m_nargs;
+        int m_fixed;    //除字符串内容外记录的长度
+        unsigned char m_args[LOG_MAX_ARGS];
+    };
+    static log_format_info m_formats[MAX_FORMATS];
+    static std::atomic<int> m_format_count;
+    static locker m_format_lock;
+
+    //交给整理线程的任务
+    enum LOG_TASK
+    {
+        TASK_CLOSE = 0,     //关闭切分下来的文件，按需压缩并清理
+        TASK_PREPARE,       //预先创建下一个文件
+        TASK_STOP
+    };
+    struct log_task
+    {
+        int m_kind;
+        FILE *m_fp;
+        char m_path[256];
+    };
+
     char dir_name[128]; //路径名
     char log_name[128]; //log文件名
     int m_split_lines;  //日志最大行数
-    int m_log_buf_size; //日志缓冲区大小
-    long long m_count;  //日志行数记录
+    int m_log_buf_size; //单行日志的最大长度
+    int m_file_lines;   //当前文件已写入的行数，由 m_mutex 保护
+    int m_split_index;  //当天的第几个切分文件
     int m_today;        //因为按天分类,记录当前时间是那一天
     FILE *m_fp;         //打开log的文件指针
-    char *m_buf;
-    block_queue<string> *m_log_queue; //阻塞队列
+    char m_path[256];   //当前文件的路径
+
+    bool m_compress;
+    int m_keep_days;
+    long long m_keep_bytes;
+    std::atomic<int> m_next_fd;            //整理线程预先创建的匿名文件(O_TMPFILE)，切换时再链接到文件名
+    block_queue<log_task> *m_tasks;
+    pthread_t m_hk_tid;
+    bool m_hk_started;
     bool m_is_async;                  //是否异步
-    locker m_mutex;
+    bool m_is_binary;                 //是否二进制
+    int m_formats_written;            //当前文件中已写出的格式定义数，由 m_mutex 保护
+    time_t m_last_flush;              //同步模式下上次刷新的时间，每秒最多刷新一次
+    locker m_mutex;                   //保护 m_fp 和当前文件的状态，写线程、切分文件和同步写时使用
 };
 
+//低于 LOG_COMPILE_LEVEL 的日志在编译期去除，如 -DLOG_COMPILE_LEVEL=1 去掉所有 debug 日志
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+//低于运行期级别的日志只有一次比较的开销，参数不会被求值
+//每个调用点的格式串在第一次执行时登记，之后直接使用其id
+#define LOG_BASE(level, format, ...)                                                     \
+    do                                                                                   \
+    {                                                                                    \
+        if (level >= LOG_COMPILE_LEVEL && level >= Log::get_level())                     \
+        {                                                                                \
+            static const int log_fmt_id = Log::register_format(level, format);           \
+            Log::get_instance()->write_log(level, log_fmt_id, format, ##__VA_ARGS__);    \
+        }                                                                                \
+    } while (0)
+
 //这四个宏定义在其他文件中使用，主要用于不同类型的日志输出; 对日志等级进行分类
 //VA_ARG宏，获取可变参数的当前参数
-#define LOG_DEBUG(format, ...) Log::get_instance()->write_log(0, format, ##__VA_ARGS__)
-#define LOG_INFO(format, ...) Log::get_instance()->write_log(1, format, ##__VA_ARGS__)
-#define LOG_WARN(format, ...) Log::get_instance()->write_log(2, format, ##__VA_ARGS__)
-#define LOG_ERROR(format, ...) Log::get_instance()->write_log(3, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_BASE(0, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_BASE(1, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_BASE(2, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_BASE(3, format, ##__VA_ARGS__)
 
 #endif
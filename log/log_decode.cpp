@@ -0,0 +1,299 @@
+/*************************************************************
+*二进制日志解码：把 BINLOG 模式写出的 .bin 文件还原成与文本日志相同的格式
+*  make log_decode
+*  ./log_decode 2026_10_19_ServerLog.bin 2026_10_19_ServerLog.bin.1 > ServerLog.txt
+*  ./log_decode -l 2 2026_10_19_ServerLog.bin      // 只输出 warn 及以上
+*不指定文件时从标准输入读取
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "log_format.h"
+using namespace std;
+
+static const char *level_str[] = {"[debug]: ", "[info]: ", "[warn]: ", "[erro]: "};
+
+struct format_info
+{
+    string m_format;
+    int m_level;
+};
+
+//按转换说明格式化一个参数，星号宽度/精度放在前面
+template <class T>
+static void put_arg(string &out, const string &spec, const int *stars, int nstars, T v)
+{
+    char tmp[512];
+    vector<char> big;
+    char *dst = tmp;
+    size_t cap = sizeof(tmp);
+    for (int i = 0; i < 2; ++i)
+    {
+        int n;
+        if (nstars == 0)
+            n = snprintf(dst, cap, spec.c_str(), v);
+        else if (nstars == 1)
+            n = snprintf(dst, cap, spec.c_str(), stars[0], v);
+        else
+            n = snprintf(dst, cap, spec.c_str(), stars[0], stars[1], v);
+        if (n < 0)
+            return;
+        if ((size_t)n < cap)
+        {
+            out.append(dst, n);
+            return;
+        }
+        big.resize(n + 1);
+        dst = &big[0];
+        cap = big.size();
+    }
+}
+
+//字面部分中的 "%%" 还原为 "%"
+static void put_literal(string &out, const char *p, const char *end)
+{
+    while (p < end)
+    {
+        out += *p;
+        p += (*p == '%' && p + 1 < end && p[1] == '%') ? 2 : 1;
+    }
+}
+
+//按格式串依次取出参数并格式化，记录不完整时返回 false
+static bool render(const string &format, const char *p, const char *end, string &out)
+{
+    const char *fmt = format.c_str();
+    log_conv c;
+    while (log_next_conv(fmt, &c) > 0)
+    {
+        put_literal(out, fmt, c.m_begin);
+        string spec(c.m_begin, c.m_end);
+        int stars[2];
+        int nstars = 0;
+        for (int i = 0; i < c.m_nargs; ++i)
+        {
+            LOG_ARG_TYPE type = c.m_args[i];
+            int size = type == LOG_ARG_INT ? 4 : (type == LOG_ARG_STR ? 2 : 8);
+            if (end - p < size)
+                return false;
+            if (i < c.m_nargs - 1)
+            {
+                memcpy(&stars[nstars++], p, 4);
+                p += 4;
+                continue;
+            }
+
+            switch (type)
+            {
+            case LOG_ARG_INT:
+            {
+                int v;
+                memcpy(&v, p, 4);
+                put_arg(out, spec, stars, nstars, v);
+                break;
+            }
+            case LOG_ARG_LONG:
+            case LOG_ARG_LLONG:
+            {
+                long long v;
+                memcpy(&v, p, 8);
+                put_arg(out, spec, stars, nstars, v);
+                break;
+            }
+            case LOG_ARG_DOUBLE:
+            case LOG_ARG_LDOUBLE:
+            {
+                double v;
+                memcpy(&v, p, 8);
+                //long double 记录时已转成 double，去掉 L 修饰
+                if (type == LOG_ARG_LDOUBLE)
+                    spec.erase(spec.find('L'), 1);
+                put_arg(out, spec, stars, nstars, v);
+                break;
+            }
+            case LOG_ARG_PTR:
+            {
+                unsigned long long v;
+                memcpy(&v, p, 8);
+                //%n 不输出
+                if (spec[spec.size() - 1] == 'p')
+                    put_arg(out, spec, stars, nstars, (void *)(uintptr_t)v);
+                break;
+            }
+            case LOG_ARG_STR:
+            {
+                uint16_t len;
+                memcpy(&len, p, 2);
+                if (end - p < 2 + len)
+                    return false;
+                string s(p + 2, len);
+                put_arg(out, spec, stars, nstars, s.c_str());
+                p += len;
+                break;
+            }
+            }
+            p += size;
+        }
+        fmt = c.m_end;
+    }
+    put_literal(out, fmt, fmt + strlen(fmt));
+    return true;
+}
+
+//时间前缀与文本日志相同："YYYY-MM-DD HH:MM:SS.uuuuuu "
+static void put_time(string &out, long long usec)
+{
+    static time_t last = -1;
+    static char prefix[80];
+    time_t sec = usec / 1000000;
+    if (sec != last)
+    {
+        struct tm my_tm;
+        localtime_r(&sec, &my_tm);
+        snprintf(prefix, sizeof(prefix), "%d-%02d-%02d %02d:%02d:%02d.",
+                 my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
+                 my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec);
+        last = sec;
+    }
+    char tail[16];
+    snprintf(tail, sizeof(tail), "%06lld ", usec % 1000000);
+    out += prefix;
+    out += tail;
+}
+
+static bool read_all(FILE *fp, vector<char> &data)
+{
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    return !ferror(fp);
+}
+
+static int decode(const char *name, FILE *fp, int min_level)
+{
+    vector<char> data;
+    if (!read_all(fp, data))
+    {
+        fprintf(stderr, "%s: read error\n", name);
+        return 1;
+    }
+    if (data.size() < sizeof(LOG_BIN_MAGIC) || memcmp(&data[0], LOG_BIN_MAGIC, sizeof(LOG_BIN_MAGIC)) != 0)
+    {
+        fprintf(stderr, "%s: not a binary log\n", name);
+        return 1;
+    }
+
+    vector<format_info> formats;
+    string out;
+    const char *p = &data[0];
+    const char *end = p + data.size();
+    while (p < end)
+    {
+        //追加写入时文件中间会再出现文件头，之后的格式id重新编号
+        if ((size_t)(end - p) >= sizeof(LOG_BIN_MAGIC) && memcmp(p, LOG_BIN_MAGIC, sizeof(LOG_BIN_MAGIC)) == 0)
+        {
+            formats.clear();
+            p += sizeof(LOG_BIN_MAGIC);
+            continue;
+        }
+
+        uint32_t len, id;
+        if (end - p < 8)
+            break;
+        memcpy(&len, p, 4);
+        memcpy(&id, p + 4, 4);
+        if (len < 8 || (size_t)(end - p) < len)
+            break;
+        const char *rec_end = p + len;
+
+        if (id == LOG_BIN_DEFINE)
+        {
+            uint32_t fid;
+            if (len < 13)
+                break;
+            memcpy(&fid, p + 8, 4);
+            if (fid >= formats.size())
+                formats.resize(fid + 1);
+            formats[fid].m_level = (unsigned char)p[12];
+            formats[fid].m_format.assign(p + 13, rec_end);
+            p = rec_end;
+            continue;
+        }
+
+        if (len < LOG_RECORD_HEAD + (id == LOG_BIN_TEXT ? 1 : 0))
+            break;
+        long long usec;
+        memcpy(&usec, p + 8, 8);
+        const char *args = p + LOG_RECORD_HEAD;
+        int level;
+        if (id == LOG_BIN_TEXT)
+            level = (unsigned char)*args++;
+        else if (id < formats.size() && !formats[id].m_format.empty())
+            level = formats[id].m_level;
+        else
+        {
+            fprintf(stderr, "%s: unknown format id %u at offset %ld\n", name, id, (long)(p - &data[0]));
+            p = rec_end;
+            continue;
+        }
+        p = rec_end;
+        if (level < min_level)
+            continue;
+        if (level < 0 || level > 3)
+            level = 1;
+
+        out.clear();
+        put_time(out, usec);
+        out += level_str[level];
+        if (id == LOG_BIN_TEXT)
+            out.append(args, rec_end);
+        else if (!render(formats[id].m_format, args, rec_end, out))
+            out += " <truncated record>";
+        out += '\n';
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+    if (p < end)
+        fprintf(stderr, "%s: %ld trailing bytes ignored\n", name, (long)(end - p));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int min_level = 0, opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            min_level = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-l level] [file.bin ...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind == argc)
+        return decode("stdin", stdin, min_level);
+
+    int ret = 0;
+    for (int i = optind; i < argc; ++i)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (!fp)
+        {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        ret |= decode(argv[i], fp, min_level);
+        fclose(fp);
+    }
+    return ret;
+}
@@ -0,0 +1,144 @@
+/*************************************************************
+*二进制日志的文件格式，写日志和离线解码共用
+*文件头:     LOG_BIN_MAGIC
+*格式定义:   uint32 记录长度 | LOG_BIN_DEFINE | uint32 格式id | uint8 级别 | 格式串(不含结尾'\0')
+*日志记录:   uint32 记录长度 | uint32 格式id | int64 时间(微秒) | 参数...
+*文本记录:   uint32 记录长度 | LOG_BIN_TEXT | int64 时间(微秒) | uint8 级别 | 已格式化的内容
+*            (格式串无法解析或格式表已满时使用)
+*参数按格式串中的顺序存放: 整数 4/8 字节，浮点 8 字节，指针 8 字节，
+*字符串为 uint16 长度 + 内容(超长截断)
+*每个文件开头都会重新写出格式定义，因此单个文件可以独立解码；
+*追加写入已有文件时会再出现文件头，解码时遇到文件头即清空格式表
+**************************************************************/
+
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+static const char LOG_BIN_MAGIC[8] = {'W', 'S', 'B', 'L', 'O', 'G', '1', '\n'};
+static const uint32_t LOG_BIN_DEFINE = 0xffffffff;
+static const uint32_t LOG_BIN_TEXT = 0xfffffffe;
+static const int LOG_RECORD_HEAD = 16;     //长度 + 格式id + 时间
+static const int LOG_MAX_ARGS = 32;
+
+enum LOG_ARG_TYPE
+{
+    LOG_ARG_INT = 0,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,
+    LOG_ARG_STR,
+    LOG_ARG_PTR
+};
+
+//格式串中的一个转换说明
+struct log_conv
+{
+    const char *m_begin;         //'%' 所在位置
+    const char *m_end;           //转换字符之后的位置
+    int m_nargs;                 //消耗的参数个数，星号宽度/精度各占一个 int
+    LOG_ARG_TYPE m_args[3];
+};
+
+//从 p 开始查找下一个转换说明，找到返回 1，没有返回 0，遇到不支持的转换(如 %m、%ls)返回 -1
+//"%%" 不消耗参数，直接跳过
+inline int log_next_conv(const char *p, log_conv *c)
+{
+    while ((p = strchr(p, '%')) != NULL)
+    {
+        if (p[1] == '%')
+        {
+            p += 2;
+            continue;
+        }
+        c->m_begin = p++;
+        c->m_nargs = 0;
+        while (*p && strchr("-+ #0'", *p))
+            ++p;
+        if (*p == '*')
+        {
+            c->m_args[c->m_nargs++] = LOG_ARG_INT;
+            ++p;
+        }
+        while (isdigit((unsigned char)*p))
+            ++p;
+        if (*p == '.')
+        {
+            ++p;
+            if (*p == '*')
+            {
+                c->m_args[c->m_nargs++] = LOG_ARG_INT;
+                ++p;
+            }
+            while (isdigit((unsigned char)*p))
+                ++p;
+        }
+
+        //长度修饰：LP64 下 l、z、j、t 都是 8 字节
+        LOG_ARG_TYPE int_type = LOG_ARG_INT;
+        bool long_double = false;
+        if (*p == 'h')
+        {
+            p += p[1] == 'h' ? 2 : 1;
+        }
+        else if (*p == 'l')
+        {
+            int_type = p[1] == 'l' ? LOG_ARG_LLONG : LOG_ARG_LONG;
+            p += p[1] == 'l' ? 2 : 1;
+        }
+        else if (*p == 'q' || *p == 'z' || *p == 'j' || *p == 't')
+        {
+            int_type = LOG_ARG_LLONG;
+            ++p;
+        }
+        else if (*p == 'L')
+        {
+            long_double = true;
+            ++p;
+        }
+
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            c->m_args[c->m_nargs++] = int_type;
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            c->m_args[c->m_nargs++] = long_double ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+            break;
+        case 'c':
+        case 's':
+            //宽字符不支持
+            if (int_type != LOG_ARG_INT || long_double)
+                return -1;
+            c->m_args[c->m_nargs++] = *p == 'c' ? LOG_ARG_INT : LOG_ARG_STR;
+            break;
+        case 'p':
+        case 'n':
+            c->m_args[c->m_nargs++] = LOG_ARG_PTR;
+            break;
+        default:
+            return -1;
+        }
+        c->m_end = p + 1;
+        return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -11,10 +11,19 @@
 
 #include "./lock/locker.h"
 #include "./threadpool/threadpool.h"
+#include "./threadpool/cpu_affinity.h"
 #include "./timer/lst_timer.h"
+#include "./timer/coarse_clock.h"
 #include "./http/http_conn.h"
 #include "./log/log.h"
+#include "./log/access_log.h"
 #include "./CGImysql/sql_connection_pool.h"
+#include "./user/user_mysql.h"
+#include "./user/user_sqlite.h"
+#include "./user/user_local.h"
+#include "./session/session_store.h"
+#include "./http/file_preload.h"
+#include "./pack/asset_pack.h"
 
 #define MAX_FD 65536           //最大文件描述符
 #define MAX_EVENT_NUMBER 10000 //最大事件数
@@ -22,6 +31,7 @@
 
 #define SYNLOG  //同步写日志
 //#define ASYNLOG //异步写日志
+//#define BINLOG  //异步二进制日志，用 log/log_decode 转成文本
 
 //#define listenfdET //边缘触发非阻塞
 #define listenfdLT //水平触发阻塞
@@ -33,8 +43,10 @@ extern int setnonblocking(int fd);
 
 //设置定时器相关参数
 static int pipefd[2];
+static int closefd[2];     //reactor 模式下工作线程通知主线程关闭连接
 static sort_timer_lst timer_lst;
 static int epollfd = 0;
+static http_conn *users = NULL;     //每个可能的 fd 对应一个 http_conn
 
 //信号处理函数
 void sig_handler(int sig)
@@ -63,18 +75,30 @@ void addsig(int sig, void(handler)(int), bool restart = true)
 void timer_handler()
 {
     timer_lst.tick();
+    //日志不再逐条刷新，空闲时由定时器把缓冲中剩余的日志写出
+    Log::get_instance()->flush();
+    //登录会话与连接共用定时器，每个 TIMESLOT 清理一次过期会话
+    session_store::get_instance()->expire(coarse_clock::now_sec());
     alarm(TIMESLOT);
 }
 
-//定时器回调函数，从内核事件表删除非活动连接事件，关闭文件描述符，释放连接资源。
+//定时器回调函数，从内核事件表删除非活动连接事件，关闭文件描述符，释放连接资源(包括正在发送的文件)。
 void cb_func(client_data *user_data)
 {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
-    close(user_data->sockfd);
-    http_conn::m_user_count--;
+    users[user_data->sockfd].close_conn();
+    user_data->timer = NULL;
     LOG_INFO("close fd %d", user_data->sockfd);
-    Log::get_instance()->flush();
+}
+
+//主线程关闭连接并删除其定时器；定时器为 NULL 说明连接已经关闭
+void close_client(client_data *user_data)
+{
+    util_timer *timer = user_data->timer;
+    if (!timer)
+        return;
+    timer->cb_func(user_data);
+    timer_lst.del_timer(timer);
 }
 
 void show_error(int connfd, const char *info)
@@ -84,46 +108,254 @@ void show_error(int connfd, const char *info)
     close(connfd);
 }
 
+//优先使用显式指定的 CPU 列表，未指定时使用 NUMA 节点的全部 CPU；返回 -1 表示列表格式错误，0 表示不绑核
+int pick_cpus(const char *list, bool has_node, const cpu_set_t *node_set, cpu_set_t *set)
+{
+    if (list)
+        return parse_cpu_list(list, set) ? 1 : -1;
+    if (!has_node)
+        return 0;
+    *set = *node_set;
+    return 1;
+}
+
 int main(int argc, char *argv[])
 {
+    //可选参数: -t 工作线程数  -q 数据库线程数(大于0时开启协程模式)  -a 事件处理模式(0 proactor, 1 reactor)
+    //         -l 日志级别(0 debug, 1 info, 2 warn, 3 error)，运行中可用 SIGUSR1/SIGUSR2 降低/提高级别
+    //         -A 访问日志抽样，每 N 个请求记录一个(1 为全部记录，默认 0 不开启)，写入 access.log
+    //         -z 用 gzip 压缩切分下来的日志  -K 日志保留天数  -S 日志总大小上限(MB)
+    //         -P 启动时并行载入用户表的连接数  -U 用户表快照文件(需要 user 表有自增列 id)
+    //         -J 注册日志文件，开启后注册先写本地日志，由后台线程批量写入数据库
+    //         -B 用户表存储后端：mysql(默认)、sqlite[:文件，默认 users.db]、local[:路径前缀，默认 users]
+    //            -P -U -J 只对 mysql 有效，其他后端不连接数据库
+    //         -D 工作线程和数据库线程各自独占一条数据库连接，不经过连接池
+    //         -E 登录会话有效期(秒)，默认 1800，0 表示不发放会话 Cookie
+    //         -M 启动时预热网站目录中的静态文件，最多 N MB，可加 lock(mlock) 和 huge(2MB 以上的文件用大页)，如 -M 64,lock,huge
+    //         -Q 每个连接每次可写事件最多发送的 KB 数，用完后让出给其他连接，默认 256，0 为不限制(一直写到套接字缓冲区满)
+    //         -F 静态资源归档(由 mkpack 生成)，开启后静态文件全部来自归档，不再访问网站目录，-M 无效
+    //绑核参数: -R 主线程  -W 工作线程  -L 写日志线程 的 CPU 列表(如 0-3,8)；
+    //         -N NUMA 节点 或 -I 网卡名(取网卡所在节点，与中断/RSS 队列对齐)，未单独指定的线程绑定到该节点上
+    int thread_number = 8;
+    int sql_thread_number = 0;
+    int actor_model = 0;
+    int access_sample = 0;
+    bool log_compress = false;
+    int log_keep_days = 0;
+    long long log_keep_mb = 0;
+    const char *reactor_cpus = NULL, *worker_cpus = NULL, *log_cpus = NULL, *nic = NULL;
+    int numa_node = -1;
+    int load_threads = 4;
+    const char *user_snapshot = NULL;
+    const char *user_journal_file = NULL;
+    const char *user_backend_spec = "mysql";
+    bool conn_affinity = false;
+    int session_ttl = 1800;
+    long long preload_mb = 0;
+    bool preload_lock = false, preload_huge = false;
+    const char *pack_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:q:a:l:A:zK:S:P:U:J:B:DE:M:F:Q:R:W:L:N:I:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            Log::set_level(atoi(optarg));
+            break;
+        case 'A':
+            access_sample = atoi(optarg);
+            break;
+        case 'z':
+            log_compress = true;
+            break;
+        case 'K':
+            log_keep_days = atoi(optarg);
+            break;
+        case 'S':
+            log_keep_mb = atoll(optarg);
+            break;
+        case 'P':
+            load_threads = atoi(optarg);
+            break;
+        case 'U':
+            user_snapshot = optarg;
+            break;
+        case 'J':
+            user_journal_file = optarg;
+            break;
+        case 'B':
+            user_backend_spec = optarg;
+            break;
+        case 'D':
+            conn_affinity = true;
+            break;
+        case 'E':
+            session_ttl = atoi(optarg);
+            break;
+        case 'M':
+            preload_mb = atoll(optarg);
+            preload_lock = strstr(optarg, "lock") != NULL;
+            preload_huge = strstr(optarg, "huge") != NULL;
+            break;
+        case 'F':
+            pack_path = optarg;
+            break;
+        case 'Q':
+            http_conn::m_send_quota = atoll(optarg) * 1024;
+            break;
+        case 'R':
+            reactor_cpus = optarg;
+            break;
+        case 'W':
+            worker_cpus = optarg;
+            break;
+        case 'L':
+            log_cpus = optarg;
+            break;
+        case 'N':
+            numa_node = atoi(optarg);
+            break;
+        case 'I':
+            nic = optarg;
+            break;
+        case 'a':
+            actor_model = atoi(optarg);
+            break;
+        case 't':
+            thread_number = atoi(optarg);
+            break;
+        case 'q':
+            sql_thread_number = atoi(optarg);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        printf("usage: %s port_number [-t thread_number] [-q sql_thread_number] [-a actor_model] [-l log_level] [-A access_sample]"
+               " [-z] [-K keep_days] [-S keep_mb] [-P load_threads] [-U user_snapshot] [-J user_journal] [-B mysql|sqlite[:file]|local[:path]] [-D] [-E session_ttl] [-M mb[,lock][,huge]] [-F site.pack] [-Q quota_kb]"
+               " [-R cpus] [-W cpus] [-L cpus] [-N numa_node] [-I ifname]\n", basename(argv[0]));
+        return 1;
+    }
+
+    if (nic && numa_node < 0)
+        numa_node = nic_numa_node(nic);
+    cpu_set_t node_set, reactor_set, worker_set, log_set;
+    bool has_node = numa_node >= 0 && node_cpu_set(numa_node, &node_set);
+    int bind_reactor = pick_cpus(reactor_cpus, has_node, &node_set, &reactor_set);
+    int bind_worker = pick_cpus(worker_cpus, has_node, &node_set, &worker_set);
+    int bind_log = pick_cpus(log_cpus, has_node, &node_set, &log_set);
+    if (bind_reactor < 0 || bind_worker < 0 || bind_log < 0)
+    {
+        printf("invalid cpu list\n");
+        return 1;
+    }
+
+    bool bind_ok = true;
+
+    Log::get_instance()->set_retention(log_compress, log_keep_days, log_keep_mb * 1024 * 1024);
 #ifdef ASYNLOG
-    Log::get_instance()->init("ServerLog", 2000, 800000, 8); //异步日志模型
+    Log::get_instance()->init("ServerLog", 2000, 800000, 64); //异步日志模型，64 块每线程缓冲
+    if (bind_log > 0 && !Log::get_instance()->bind_cpus(&log_set))
+        bind_ok = false;
+#endif
+
+#ifdef BINLOG
+    Log::get_instance()->init("ServerLog", 2000, 800000, 64, true); //二进制日志，只记录参数，不在请求线程中格式化
+    if (bind_log > 0 && !Log::get_instance()->bind_cpus(&log_set))
+        bind_ok = false;
 #endif
 
 #ifdef SYNLOG
     Log::get_instance()->init("ServerLog", 2000, 800000, 0); //同步日志模型
 #endif
 
-    if (argc <= 1)
+    //访问日志与诊断日志分开，写线程同样绑定到 -L 指定的 CPU
+    if (access_sample > 0)
     {
-        printf("usage: %s ip_address port_number\n", basename(argv[0]));
-        return 1;
+        if (!access_log::get_instance()->init("access.log", access_sample))
+            LOG_ERROR("%s", "open access.log failed");
+        else if (bind_log > 0 && !access_log::get_instance()->bind_cpus(&log_set))
+            bind_ok = false;
     }
 
-    int port = atoi(argv[1]);
+    int port = atoi(argv[optind]);
 // 忽略 sigpipe信号
     addsig(SIGPIPE, SIG_IGN);             //这句很重要，防止向已关闭的对端发送数据，引起程序的异常终止。
 
-    //创建数据库连接池
-    connection_pool *connPool = connection_pool::GetInstance();
-    connPool->init("localhost", "root", "root", "webserver", 3306, 8);   // 连接池中 有 8条数据库连接
+    //选择用户表的存储后端，只有 mysql 后端创建数据库连接池
+    connection_pool *connPool = NULL;
+    user_backend *backend = NULL;
+    if (strncmp(user_backend_spec, "sqlite", 6) == 0 && (user_backend_spec[6] == '\0' || user_backend_spec[6] == ':'))
+        backend = new user_sqlite(user_backend_spec[6] ? user_backend_spec + 7 : "users.db");
+    else if (strncmp(user_backend_spec, "local", 5) == 0 && (user_backend_spec[5] == '\0' || user_backend_spec[5] == ':'))
+        backend = new user_local(user_backend_spec[5] ? user_backend_spec + 6 : "users");
+    else if (strcmp(user_backend_spec, "mysql") == 0)
+    {
+        //创建数据库连接池
+        connPool = connection_pool::GetInstance();
+        //连接池中最多 8 条数据库连接；数据库暂时不可用时继续启动，后台线程每秒重试
+        if (!connPool->init("localhost", "root", "root", "webserver", 3306, 8))
+            LOG_ERROR("%s", "mysql unavailable, connection pool will keep retrying");
+        backend = new user_mysql(connPool, load_threads, user_snapshot, user_journal_file);
+    }
+    else
+    {
+        printf("unknown user backend %s\n", user_backend_spec);
+        return 1;
+    }
+    //没有连接池时数据库线程无事可做
+    if (!connPool)
+        sql_thread_number = 0;
 
     //创建线程池   T=http_conn，表示任务类型
     threadpool<http_conn> *pool = NULL;
     try
     {
-        pool = new threadpool<http_conn>(connPool);
+        pool = new threadpool<http_conn>(connPool, thread_number, 10000, sql_thread_number, actor_model, conn_affinity);
     }
     catch (...)
     {
         return 1;
     }
+    if (bind_worker > 0 && !pool->bind_cpus(&worker_set))
+        bind_ok = false;
+    if (sql_thread_number > 0)
+        http_conn::m_sql_sched = pool;
+    http_conn::m_actor_model = actor_model;
+    http_conn::m_user_backend = backend;
+
+    asset_pack *pack = NULL;
+    if (pack_path)
+    {
+        pack = new asset_pack;
+        if (!pack->open(pack_path))
+        {
+            printf("load pack %s failed\n", pack_path);
+            return 1;
+        }
+        http_conn::m_asset_pack = pack;
+    }
 
-    http_conn *users = new http_conn[MAX_FD];  // 预先为每个可能的客户 分配一个 http_conn 对象（重要）
+    users = new http_conn[MAX_FD];  // 预先为每个可能的客户 分配一个 http_conn 对象（重要）
     assert(users);
 
-    //载入 数据库表，将数据库中的数据载入到服务器中。
-    users->initmysql_result(connPool);
+    //载入 用户表，将存储后端中的用户载入到服务器中。
+    if (!backend->load(user_store::get_instance()))
+    {
+        printf("load users from %s backend failed\n", backend->name());
+        return 1;
+    }
+    if (!session_store::get_instance()->init(session_ttl))
+    {
+        printf("%s\n", "init session key failed");
+        return 1;
+    }
+    //后台预热，不推迟开始监听；预热完成前的请求照常读取文件
+    if (preload_mb > 0 && !pack && !file_preload::get_instance()->start(doc_root, preload_mb * 1024 * 1024, preload_lock, preload_huge))
+        LOG_WARN("%s", "start preload thread failed");
 
     int listenfd = socket(PF_INET, SOCK_STREAM, 0);
     assert(listenfd >= 0);
@@ -160,13 +392,28 @@ int main(int argc, char *argv[])
     setnonblocking(pipefd[1]);               // pipefd[1] 写管道，设置 非阻塞模式
     addfd(epollfd, pipefd[0], false);        // 注册pipefd[0]上的可读事件
 
+    //工作线程写入待关闭连接的 fd，每次 4 字节，不超过 PIPE_BUF 保证原子性
+    ret = pipe(closefd);
+    assert(ret != -1);
+    addfd(epollfd, closefd[0], false);
+    http_conn::m_close_pipe = closefd[1];
+
     addsig(SIGALRM, sig_handler, false);      //时钟超时引起
     addsig(SIGTERM, sig_handler, false);       // 允许 kill 结束进程
+    addsig(SIGUSR1, sig_handler, false);       // 输出更详细的日志
+    addsig(SIGUSR2, sig_handler, false);       // 输出更少的日志
     bool stop_server = false;
 
     //创建连接资源数组
     client_data *users_timer = new client_data[MAX_FD];
 
+    //主线程最后绑核：启动期间创建的其他线程(日志整理、连接池维护、用户表载入、预热等)保持进程原有的亲和性，
+    //不继承 -R 的 CPU 列表；只有工作线程和写日志线程按 -W/-L 单独绑定
+    if (bind_reactor > 0 && !bind_thread(pthread_self(), &reactor_set))
+        bind_ok = false;
+    if (!bind_ok)
+        LOG_WARN("%s", "bind cpu failed, some threads are not pinned");
+
     bool timeout = false;
     alarm(TIMESLOT);           //每隔TIMESLOT时间触发SIGALRM信号           
 
@@ -203,6 +450,9 @@ int main(int argc, char *argv[])
                 }
                 
                 
+                //工作线程自行关闭的连接(proactor 下写失败)留下的定时器
+                if (users_timer[connfd].timer)
+                    timer_lst.del_timer(users_timer[connfd].timer);
                 users[connfd].init(connfd, client_address);       // http_conn *users = new http_conn[MAX_FD];  users 是一个数组
 
                 //初始化client_data数据
@@ -212,7 +462,7 @@ int main(int argc, char *argv[])
                 util_timer *timer = new util_timer;            // 创建 定时器
                 timer->user_data = &users_timer[connfd];       // 绑定 用户数据
                 timer->cb_func = cb_func;                       // 设置其 回调函数
-                time_t cur = time(NULL);
+                time_t cur = coarse_clock::now_sec();
                 timer->expire = cur + 3 * TIMESLOT;            // 设置 超时时间
                 users_timer[connfd].timer = timer;             
                 timer_lst.add_timer(timer);                    // 将 定时器 添加到 链表中
@@ -233,6 +483,8 @@ int main(int argc, char *argv[])
                         LOG_ERROR("%s", "Internal server busy");
                         break;
                     }
+                    if (users_timer[connfd].timer)
+                        timer_lst.del_timer(users_timer[connfd].timer);
                     users[connfd].init(connfd, client_address);
 
                     //初始化client_data数据
@@ -242,7 +494,7 @@ int main(int argc, char *argv[])
                     util_timer *timer = new util_timer;
                     timer->user_data = &users_timer[connfd];
                     timer->cb_func = cb_func;
-                    time_t cur = time(NULL);
+                    time_t cur = coarse_clock::now_sec();
                     timer->expire = cur + 3 * TIMESLOT;
                     users_timer[connfd].timer = timer;
                     timer_lst.add_timer(timer);
@@ -254,13 +506,7 @@ int main(int argc, char *argv[])
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) //EPOLLRDHUP 对端关闭连接;EPOLLHUP 挂起; 错误
             {
                 //服务器端关闭连接，移除对应的定时器
-                util_timer *timer = users_timer[sockfd].timer;
-                timer->cb_func(&users_timer[sockfd]);
-
-                if (timer)
-                {
-                    timer_lst.del_timer(timer);
-                }
+                close_client(&users_timer[sockfd]);
             }
 
             //处理信号。 利用 alarm 函数周期性地触发 SIGALRM 信号，该信号的信号处理函数 利用管道通知主循环 执行定时器上的定时任务。
@@ -291,70 +537,118 @@ int main(int argc, char *argv[])
                         case SIGTERM:
                         {
                             stop_server = true;
+                            break;
+                        }
+                        case SIGUSR1:
+                        {
+                            Log::set_level(Log::get_level() - 1);
+                            break;
+                        }
+                        case SIGUSR2:
+                        {
+                            Log::set_level(Log::get_level() + 1);
+                            break;
                         }
                         }
                     }
                 }
             }
 
+            //reactor 模式下工作线程读写失败，由主线程关闭连接并删除定时器
+            else if ((sockfd == closefd[0]) && (events[i].events & EPOLLIN))
+            {
+                //只丢弃 generation 不符的请求：该 fd 已被关闭并分配给了新连接
+                http_conn::close_notice notices[256];
+                ret = read(closefd[0], notices, sizeof(notices));
+                for (int j = 0; j < ret / (int)sizeof(http_conn::close_notice); ++j)
+                {
+                    int fd = notices[j].fd;
+                    if (fd < 0 || fd >= MAX_FD || users[fd].generation() != notices[j].generation)
+                        continue;
+                    close_client(&users_timer[fd]);
+                }
+            }
+
             //处理客户连接上接收到的数据
             else if (events[i].events & EPOLLIN)
             {
                 util_timer *timer = users_timer[sockfd].timer;
-         
-                if (users[sockfd].read_once())  // 由 主线程 接收请求并将所有数据读入对应buffer
+
+                //reactor：主线程只分发读事件，读取和处理都在工作线程
+                if (1 == actor_model)
                 {
-                    LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
-                    Log::get_instance()->flush();
+                    if (!pool->append(users + sockfd, 0))
+                    {
+                        LOG_WARN("request queue full, close fd %d", sockfd);
+                        close_client(&users_timer[sockfd]);
+                    }
+                    else if (timer)
+                    {
+                        time_t cur = coarse_clock::now_sec();
+                        timer->expire = cur + 3 * TIMESLOT;
+                        timer_lst.adjust_timer(timer);
+                    }
+                }
+                else if (users[sockfd].read_once())  // 由 主线程 接收请求并将所有数据读入对应buffer
+                {
+                    LOG_DEBUG("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
                     //若监测到读事件，将该事件放入请求队列  （主线程往 工作队列中添加任务。工作线程 竞争得到任务并执行）
-                    pool->append(users + sockfd);         
-
+                    if (!pool->append(users + sockfd))
+                    {
+                        LOG_WARN("request queue full, close fd %d", sockfd);
+                        close_client(&users_timer[sockfd]);
+                    }
                     //若有数据传输，则将定时器往后延迟3个单位
                     //并对新的定时器在链表上的位置进行调整
-                    if (timer)
+                    else if (timer)
                     {
-                        time_t cur = time(NULL);
+                        time_t cur = coarse_clock::now_sec();
                         timer->expire = cur + 3 * TIMESLOT;
-                        LOG_INFO("%s", "adjust timer once");
-                        Log::get_instance()->flush();
+                        LOG_DEBUG("%s", "adjust timer once");
                         timer_lst.adjust_timer(timer);
                     }
                 }
                 else
                 {
-                    timer->cb_func(&users_timer[sockfd]);
-                    if (timer)
-                    {
-                        timer_lst.del_timer(timer);
-                    }
+                    close_client(&users_timer[sockfd]);
                 }
             }
             else if (events[i].events & EPOLLOUT)         // 可写
             {
                 util_timer *timer = users_timer[sockfd].timer;
-                if (users[sockfd].write())               //  主线程检测写事件，并调用 http_conn::write 函数将响应报文发送给浏览器端 
+
+                //reactor：剩余的响应由工作线程继续发送
+                if (1 == actor_model)
                 {
-                    LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
-                    Log::get_instance()->flush();
+                    if (!pool->append(users + sockfd, 1))
+                    {
+                        LOG_WARN("request queue full, close fd %d", sockfd);
+                        close_client(&users_timer[sockfd]);
+                    }
+                    else if (timer)
+                    {
+                        time_t cur = coarse_clock::now_sec();
+                        timer->expire = cur + 3 * TIMESLOT;
+                        timer_lst.adjust_timer(timer);
+                    }
+                }
+                else if (users[sockfd].write())               //  主线程检测写事件，并调用 http_conn::write 函数将响应报文发送给浏览器端 
+                {
+                    LOG_DEBUG("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
                     //若有数据传输，则将定时器往后延迟3个单位
                     //并对新的定时器在链表上的位置进行调整
                     if (timer)
                     {
-                        time_t cur = time(NULL);
+                        time_t cur = coarse_clock::now_sec();
                         timer->expire = cur + 3 * TIMESLOT;
-                        LOG_INFO("%s", "adjust timer once");
-                        Log::get_instance()->flush();
+                        LOG_DEBUG("%s", "adjust timer once");
                         timer_lst.adjust_timer(timer);
                     }
                 }
                 else
                 {
-                    timer->cb_func(&users_timer[sockfd]);
-                    if (timer)
-                    {
-                        timer_lst.del_timer(timer);
-                    }
+                    close_client(&users_timer[sockfd]);
                 }
             }
         }
@@ -371,6 +665,13 @@ int main(int argc, char *argv[])
     close(listenfd);
     close(pipefd[1]);
     close(pipefd[0]);
+    close(closefd[1]);
+    close(closefd[0]);
+    //写完存储后端中尚未持久化的注册
+    backend->stop();
+    delete backend;
+    delete pack;
+    file_preload::get_instance()->stop();
     delete[] users;
     delete[] users_timer;
     delete pool;
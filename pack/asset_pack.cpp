@@ -0,0 +1,131 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "asset_pack.h"
+#include "../log/log.h"
+
+asset_pack::asset_pack()
+{
+    m_base = NULL;
+    m_len = 0;
+    m_head = NULL;
+    m_entries = NULL;
+    m_slots = NULL;
+    m_names = NULL;
+    m_mask = 0;
+}
+
+asset_pack::~asset_pack()
+{
+    if (m_base)
+        munmap(m_base, m_len);
+}
+
+bool asset_pack::open(const char *path)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_ERROR("open pack %s failed", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(pack_header))
+    {
+        LOG_ERROR("pack %s is too short", path);
+        close(fd);
+        return false;
+    }
+    //打包工具用 rename 替换归档，已映射的旧文件不受影响
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        LOG_ERROR("mmap pack %s failed", path);
+        return false;
+    }
+    m_base = (char *)p;
+    m_len = st.st_size;
+    m_head = (const pack_header *)m_base;
+    if (!check())
+    {
+        LOG_ERROR("pack %s is corrupt or of another version", path);
+        munmap(m_base, m_len);
+        m_base = NULL;
+        return false;
+    }
+    m_entries = (const pack_entry *)(m_base + m_head->entries_off);
+    m_slots = (const uint32_t *)(m_base + m_head->slots_off);
+    m_names = m_base + m_head->names_off;
+    m_mask = m_head->buckets - 1;
+    //文件表和哈希槽每次查找都会访问，提前读入
+    madvise(m_base, m_head->names_off, MADV_WILLNEED);
+
+    m_files.resize(m_head->count);
+    for (uint32_t i = 0; i < m_head->count; ++i)
+    {
+        const pack_entry &e = m_entries[i];
+        packed_file &f = m_files[i];
+        f.data = m_base + e.offset;
+        f.length = e.length;
+        f.gz_data = e.gz_length ? m_base + e.gz_offset : NULL;
+        f.gz_length = e.gz_length;
+        f.etag = e.etag;
+        f.last_modified = e.last_modified;
+        f.mime = mime_lookup(m_names + e.name_off);
+    }
+    LOG_INFO("loaded pack %s: %u files, %zu bytes", path, m_head->count, m_len);
+    return true;
+}
+
+//所有偏移和长度都落在文件内，路径和 ETag 以 '\0' 结尾，日期长度正确，哈希槽指向有效的下标
+bool asset_pack::check() const
+{
+    const pack_header &h = *m_head;
+    if (memcmp(h.magic, PACK_MAGIC, sizeof(h.magic)) != 0 || h.version != PACK_VERSION || h.total_size != m_len)
+        return false;
+    if (h.buckets == 0 || (h.buckets & (h.buckets - 1)) != 0 || h.buckets <= h.count)
+        return false;
+    if (h.entries_off != sizeof(pack_header) || h.entries_off + (uint64_t)h.count * sizeof(pack_entry) > h.slots_off ||
+        h.slots_off + (uint64_t)h.buckets * sizeof(uint32_t) > h.names_off || h.names_off > m_len)
+        return false;
+
+    const pack_entry *entries = (const pack_entry *)(m_base + h.entries_off);
+    const uint32_t *slots = (const uint32_t *)(m_base + h.slots_off);
+    uint64_t names_len = m_len - h.names_off;
+    for (uint32_t i = 0; i < h.count; ++i)
+    {
+        const pack_entry &e = entries[i];
+        if (e.offset > m_len || e.length > m_len - e.offset || e.gz_offset > m_len || e.gz_length > m_len - e.gz_offset)
+            return false;
+        if ((uint64_t)e.name_off + e.name_len >= names_len || m_base[h.names_off + e.name_off + e.name_len] != '\0')
+            return false;
+        if (memchr(e.etag, '\0', sizeof(e.etag)) == NULL || strnlen(e.last_modified, sizeof(e.last_modified)) != PACK_DATE_LEN)
+            return false;
+    }
+    //至少有一个空槽，否则查找不到的路径会一直探测下去
+    uint32_t empty = 0;
+    for (uint32_t i = 0; i < h.buckets; ++i)
+    {
+        if (slots[i] == PACK_EMPTY_SLOT)
+            ++empty;
+        else if (slots[i] >= h.count)
+            return false;
+    }
+    return empty > 0;
+}
+
+const packed_file *asset_pack::find(const char *path, size_t len) const
+{
+    uint64_t h = pack_hash(path, len);
+    //槽数不少于文件数的两倍，探测总会遇到空槽
+    for (uint32_t s = h & m_mask; m_slots[s] != PACK_EMPTY_SLOT; s = (s + 1) & m_mask)
+    {
+        const pack_entry &e = m_entries[m_slots[s]];
+        if (e.hash == h && e.name_len == len && memcmp(m_names + e.name_off, path, len) == 0)
+            return &m_files[m_slots[s]];
+    }
+    return NULL;
+}
@@ -0,0 +1,54 @@
+/*************************************************************
+*静态资源归档(见 pack_format.h、mkpack.cpp)的读取：启动时整个归档只读映射一次并检查格式，
+*之后每次查找只算一次路径哈希、线性探测哈希槽，返回的内容直接指向映射区，不 stat、不 open、不复制
+*MIME 类型在载入时按路径查好，ETag 和 Last-Modified 由打包工具算好放在归档中
+**************************************************************/
+
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "pack_format.h"
+#include "../http/mime_types.h"
+
+struct packed_file
+{
+    const char *data;
+    uint64_t length;
+    const char *gz_data;        //gzip 版本，没有时为 NULL
+    uint64_t gz_length;
+    const char *etag;           //含双引号
+    const char *last_modified;
+    const mime_type *mime;
+};
+
+class asset_pack
+{
+public:
+    asset_pack();
+    ~asset_pack();
+
+    //映射归档并检查格式，失败时写日志并返回 false
+    bool open(const char *path);
+    //path 相对网站目录，以 '/' 开头，不含查询串
+    const packed_file *find(const char *path, size_t len) const;
+    size_t count() const { return m_files.size(); }
+    size_t size() const { return m_len; }
+
+private:
+    bool check() const;
+
+private:
+    char *m_base;
+    size_t m_len;
+    const pack_header *m_head;
+    const pack_entry *m_entries;
+    const uint32_t *m_slots;
+    const char *m_names;
+    uint32_t m_mask;
+    std::vector<packed_file> m_files;   //与文件表下标对应
+};
+
+#endif
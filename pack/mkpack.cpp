@@ -0,0 +1,301 @@
+/*************************************************************
+*静态资源打包：把网站目录打成一个归档文件，服务器用 -F 载入后不再访问网站目录
+*  make mkpack
+*  ./mkpack root site.pack          // 只存原始内容
+*  ./mkpack -z root site.pack       // 可压缩的类型再存一份 gzip 版本(调用 gzip -9)，至少小 10% 才保留
+*先写到 site.pack.tmp 再 rename，正在运行的服务器不受影响，重启后使用新的归档
+*文件格式见 pack_format.h
+**************************************************************/
+
+#include <ftw.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "pack_format.h"
+#include "../http/mime_types.h"
+#include "../http/response_writer.h"
+using namespace std;
+
+struct pack_file
+{
+    string path;                //磁盘上的路径
+    string name;                //相对网站目录，以 '/' 开头
+    struct stat st;
+    string gz;                  //gzip 版本，不值得压缩时为空
+    pack_entry entry;
+};
+
+static vector<pack_file> files;
+static size_t root_len;
+
+static int collect(const char *path, const struct stat *st, int type, struct FTW *)
+{
+    if (type != FTW_F || !S_ISREG(st->st_mode))
+        return 0;
+    //服务器不发送其他用户不可读的文件，打包时同样跳过
+    if (!(st->st_mode & S_IROTH))
+    {
+        fprintf(stderr, "skip %s: not world-readable\n", path);
+        return 0;
+    }
+    pack_file f;
+    f.path = path;
+    f.name = path + root_len;
+    f.st = *st;
+    files.push_back(f);
+    return 0;
+}
+
+//读完整个文件并计算内容哈希
+static bool hash_file(pack_file &f, uint64_t *hash)
+{
+    int fd = open(f.path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    uint64_t h = 14695981039346656037ULL;
+    char buf[65536];
+    ssize_t n;
+    off_t total = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t i = 0; i < n; ++i)
+        {
+            h ^= (unsigned char)buf[i];
+            h *= 1099511628211ULL;
+        }
+        total += n;
+    }
+    close(fd);
+    *hash = h;
+    return n == 0 && total == f.st.st_size;
+}
+
+//调用 gzip -9 -n -c 压缩，gzip 不存在或失败时返回 false
+static bool gzip_file(const string &path, string *out)
+{
+    int in = open(path.c_str(), O_RDONLY);
+    if (in < 0)
+        return false;
+    int pfd[2];
+    if (pipe(pfd) != 0)
+    {
+        close(in);
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(in, 0);
+        dup2(pfd[1], 1);
+        close(pfd[0]);
+        close(pfd[1]);
+        close(in);
+        execlp("gzip", "gzip", "-9", "-n", "-c", (char *)NULL);
+        _exit(127);
+    }
+    close(in);
+    close(pfd[1]);
+    if (pid < 0)
+    {
+        close(pfd[0]);
+        return false;
+    }
+    char buf[65536];
+    ssize_t n;
+    out->clear();
+    while ((n = read(pfd[0], buf, sizeof(buf))) > 0)
+        out->append(buf, n);
+    close(pfd[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return n == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool pad_to(int fd, uint64_t *pos, uint64_t target)
+{
+    static const char zeros[PACK_PAGE] = {0};
+    while (*pos < target)
+    {
+        size_t n = min<uint64_t>(target - *pos, sizeof(zeros));
+        if (!write_all(fd, zeros, n))
+            return false;
+        *pos += n;
+    }
+    return true;
+}
+
+//复制原始内容，长度或修改时间与打包开始时不同说明文件在打包期间被改写
+static bool copy_file(int out, const pack_file &f)
+{
+    int fd = open(f.path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size == f.st.st_size && st.st_mtime == f.st.st_mtime;
+    char buf[65536];
+    ssize_t n = 0;
+    off_t total = 0;
+    while (ok && (n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        ok = write_all(out, buf, n);
+        total += n;
+    }
+    close(fd);
+    return ok && n == 0 && total == f.st.st_size;
+}
+
+int main(int argc, char *argv[])
+{
+    bool compress = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "z")) != -1)
+    {
+        if (opt == 'z')
+            compress = true;
+        else
+            return 1;
+    }
+    if (argc - optind != 2)
+    {
+        fprintf(stderr, "usage: %s [-z] root_dir out.pack\n", argv[0]);
+        return 1;
+    }
+    string root = argv[optind];
+    while (root.size() > 1 && root.back() == '/')
+        root.pop_back();
+    string out_path = argv[optind + 1];
+    root_len = root.size();
+
+    if (nftw(root.c_str(), collect, 16, 0) != 0)
+    {
+        perror(root.c_str());
+        return 1;
+    }
+    sort(files.begin(), files.end(), [](const pack_file &a, const pack_file &b) { return a.name < b.name; });
+    if (files.size() >= PACK_EMPTY_SLOT / 2)
+    {
+        fprintf(stderr, "too many files\n");
+        return 1;
+    }
+
+    //文件表、哈希槽和路径
+    uint32_t count = files.size();
+    uint32_t buckets = 16;
+    while (buckets < 2 * count)
+        buckets *= 2;
+    vector<uint32_t> slots(buckets, PACK_EMPTY_SLOT);
+    string names;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        pack_file &f = files[i];
+        pack_entry &e = f.entry;
+        memset(&e, 0, sizeof(e));
+        uint64_t content_hash;
+        if (!hash_file(f, &content_hash))
+        {
+            fprintf(stderr, "read %s failed\n", f.path.c_str());
+            return 1;
+        }
+        snprintf(e.etag, sizeof(e.etag), "\"%016llx\"", (unsigned long long)content_hash);
+        format_http_date(e.last_modified, f.st.st_mtime);
+        e.hash = pack_hash(f.name.data(), f.name.size());
+        e.length = f.st.st_size;
+        e.name_off = names.size();
+        e.name_len = f.name.size();
+        names.append(f.name);
+        names.push_back('\0');
+
+        if (compress && mime_lookup(f.name.c_str())->compressible && f.st.st_size > 0 &&
+            (!gzip_file(f.path, &f.gz) || f.gz.size() * 10 > (size_t)f.st.st_size * 9))
+            f.gz.clear();
+        e.gz_length = f.gz.size();
+
+        uint32_t s = e.hash & (buckets - 1);
+        while (slots[s] != PACK_EMPTY_SLOT)
+            s = (s + 1) & (buckets - 1);
+        slots[s] = i;
+    }
+
+    pack_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PACK_MAGIC, sizeof(h.magic));
+    h.version = PACK_VERSION;
+    h.count = count;
+    h.buckets = buckets;
+    h.entries_off = sizeof(h);
+    h.slots_off = h.entries_off + (uint64_t)count * sizeof(pack_entry);
+    h.names_off = h.slots_off + (uint64_t)buckets * sizeof(uint32_t);
+    uint64_t pos = h.names_off + names.size();
+    uint64_t raw_bytes = 0, gz_saved = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        pack_entry &e = files[i].entry;
+        e.offset = pack_align(pos, e.length);
+        pos = e.offset + e.length;
+        if (e.gz_length)
+        {
+            e.gz_offset = pack_align(pos, e.gz_length);
+            pos = e.gz_offset + e.gz_length;
+            gz_saved += e.length - e.gz_length;
+        }
+        raw_bytes += e.length;
+    }
+    h.total_size = pos;
+
+    string tmp_path = out_path + ".tmp";
+    int out = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+    {
+        perror(tmp_path.c_str());
+        return 1;
+    }
+    bool ok = write_all(out, &h, sizeof(h));
+    for (uint32_t i = 0; ok && i < count; ++i)
+        ok = write_all(out, &files[i].entry, sizeof(pack_entry));
+    ok = ok && write_all(out, &slots[0], slots.size() * sizeof(uint32_t)) && write_all(out, names.data(), names.size());
+    pos = h.names_off + names.size();
+    for (uint32_t i = 0; ok && i < count; ++i)
+    {
+        const pack_file &f = files[i];
+        ok = pad_to(out, &pos, f.entry.offset) && copy_file(out, f);
+        pos += f.entry.length;
+        if (ok && f.entry.gz_length)
+        {
+            ok = pad_to(out, &pos, f.entry.gz_offset) && write_all(out, f.gz.data(), f.gz.size());
+            pos += f.gz.size();
+        }
+        if (!ok)
+            fprintf(stderr, "pack %s failed (changed while packing?)\n", f.path.c_str());
+    }
+    ok = ok && fsync(out) == 0;
+    if (close(out) != 0 || !ok || rename(tmp_path.c_str(), out_path.c_str()) != 0)
+    {
+        unlink(tmp_path.c_str());
+        fprintf(stderr, "write %s failed\n", out_path.c_str());
+        return 1;
+    }
+    printf("%u files, %llu bytes, gzip saved %llu bytes, archive %llu bytes\n", count, (unsigned long long)raw_bytes,
+           (unsigned long long)gz_saved, (unsigned long long)h.total_size);
+    return 0;
+}
@@ -0,0 +1,74 @@
+/*************************************************************
+*静态资源归档的文件格式，打包工具(mkpack)和服务器共用
+*文件头:     pack_header
+*文件表:     pack_entry[count]，按路径排序
+*哈希槽:     uint32[buckets]，存文件表下标，空槽为 PACK_EMPTY_SLOT；按 pack_hash(路径) 线性探测
+*路径:       所有路径依次存放(含开头的 '/'，每个后面有 '\0')
+*内容:       每个文件的原始内容，值得压缩时再跟一份 gzip 版本，每段起点按 PACK_ALIGN 对齐，
+*            不小于 PACK_PAGE_ALIGN_MIN 的段按页对齐
+*所有整数为小端，写入和读取的机器字节序相同
+**************************************************************/
+
+#ifndef PACK_FORMAT_H
+#define PACK_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+static const char PACK_MAGIC[8] = {'W', 'S', 'P', 'A', 'C', 'K', '1', '\n'};
+static const uint32_t PACK_VERSION = 1;
+static const uint32_t PACK_EMPTY_SLOT = 0xffffffff;
+static const uint64_t PACK_ALIGN = 64;
+static const uint64_t PACK_PAGE_ALIGN_MIN = 64 * 1024;
+static const uint64_t PACK_PAGE = 4096;
+static const int PACK_ETAG_LEN = 18;               //双引号 + 16 位十六进制 + 双引号
+static const int PACK_DATE_LEN = 29;               //与 HTTP_DATE_LEN 相同
+
+struct pack_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;             //文件数
+    uint32_t buckets;           //哈希槽数，2 的幂，不少于文件数的两倍
+    uint32_t reserved;
+    uint64_t entries_off;
+    uint64_t slots_off;
+    uint64_t names_off;
+    uint64_t total_size;        //整个归档的长度，用于发现截断
+};
+
+struct pack_entry
+{
+    uint64_t hash;              //pack_hash(路径)
+    uint64_t offset;            //原始内容
+    uint64_t length;
+    uint64_t gz_offset;         //gzip 版本，没有时长度为 0
+    uint64_t gz_length;
+    uint32_t name_off;          //相对 names_off
+    uint32_t name_len;
+    char etag[PACK_ETAG_LEN + 2];               //内容的哈希，如 "\"0123456789abcdef\""，'\0' 结尾
+    char last_modified[PACK_DATE_LEN + 7];      //打包时文件的修改时间，已格式化，'\0' 结尾，补齐到 8 字节
+};
+
+static_assert(sizeof(pack_header) == 56, "pack_header layout changed");
+static_assert(sizeof(pack_entry) == 104, "pack_entry layout changed");
+
+//FNV-1a 64
+inline uint64_t pack_hash(const char *s, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+inline uint64_t pack_align(uint64_t off, uint64_t len)
+{
+    uint64_t a = len >= PACK_PAGE_ALIGN_MIN ? PACK_PAGE : PACK_ALIGN;
+    return (off + a - 1) & ~(a - 1);
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include "session_store.h"
+#include "../timer/coarse_clock.h"
+
+session_store::session_store()
+{
+    m_ttl = 0;
+    m_key[0] = m_key[1] = 0;
+    m_next_id = 1;
+}
+
+bool session_store::init(int ttl)
+{
+    m_ttl = 0;
+    if (ttl <= 0)
+        return true;
+    if (getrandom(m_key, sizeof(m_key), 0) != (ssize_t)sizeof(m_key))
+        return false;
+    m_ttl = ttl;
+    return true;
+}
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND                 \
+    do                           \
+    {                            \
+        v0 += v1;                \
+        v1 = ROTL(v1, 13);       \
+        v1 ^= v0;                \
+        v0 = ROTL(v0, 32);       \
+        v2 += v3;                \
+        v3 = ROTL(v3, 16);       \
+        v3 ^= v2;                \
+        v0 += v3;                \
+        v3 = ROTL(v3, 21);       \
+        v3 ^= v0;                \
+        v2 += v1;                \
+        v1 = ROTL(v1, 17);       \
+        v1 ^= v2;                \
+        v2 = ROTL(v2, 32);       \
+    } while (0)
+
+//SipHash-2-4，消息固定为 12 字节：会话编号(8) + 过期时间(4)
+uint64_t session_store::sign(uint64_t id, uint32_t expire)
+{
+    uint64_t v0 = 0x736f6d6570736575ULL ^ m_key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ m_key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ m_key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ m_key[1];
+    //第一个 8 字节块
+    v3 ^= id;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= id;
+    //最后一块：剩余 4 字节，最高字节为消息总长度
+    uint64_t b = ((uint64_t)12 << 56) | expire;
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static void put_hex(char *out, uint64_t v, int digits)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; --i, v >>= 4)
+        out[i] = hex[v & 15];
+}
+
+//不是十六进制字符时返回 false
+static bool get_hex(const char *in, int digits, uint64_t *v)
+{
+    uint64_t r = 0;
+    for (int i = 0; i < digits; ++i)
+    {
+        char c = in[i];
+        int d;
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            d = c - 'a' + 10;
+        else
+            return false;
+        r = r << 4 | d;
+    }
+    *v = r;
+    return true;
+}
+
+bool session_store::create(const char *name, char *token)
+{
+    if (m_ttl <= 0)
+        return false;
+    uint64_t id = __atomic_fetch_add(&m_next_id, 1, __ATOMIC_RELAXED);
+    time_t expire = coarse_clock::now_sec() + m_ttl;
+
+    session_shard &s = shard(id);
+    s.m_lock.wrlock();
+    s.m_sessions[id] = name;
+    s.m_queue.push_back(std::make_pair(expire, id));
+    s.m_lock.unlock();
+
+    put_hex(token, id, 16);
+    put_hex(token + 16, (uint32_t)expire, 8);
+    put_hex(token + 24, sign(id, (uint32_t)expire), 16);
+    token[TOKEN_LEN] = '\0';
+    return true;
+}
+
+bool session_store::check(const char *token, size_t len, std::string *name)
+{
+    uint64_t id, expire, mac;
+    if (m_ttl <= 0 || len != TOKEN_LEN || !get_hex(token, 16, &id) || !get_hex(token + 16, 8, &expire) ||
+        !get_hex(token + 24, 16, &mac))
+        return false;
+    if ((time_t)expire <= coarse_clock::now_sec() || sign(id, (uint32_t)expire) != mac)
+        return false;
+
+    session_shard &s = shard(id);
+    s.m_lock.rdlock();
+    std::unordered_map<uint64_t, std::string>::iterator it = s.m_sessions.find(id);
+    bool ok = it != s.m_sessions.end();
+    if (ok && name)
+        *name = it->second;
+    s.m_lock.unlock();
+    return ok;
+}
+
+size_t session_store::expire(time_t now)
+{
+    size_t n = 0;
+    for (int i = 0; i < SHARD_COUNT; ++i)
+    {
+        session_shard &s = m_shards[i];
+        s.m_lock.wrlock();
+        while (!s.m_queue.empty() && s.m_queue.front().first <= now)
+        {
+            s.m_sessions.erase(s.m_queue.front().second);
+            s.m_queue.pop_front();
+            ++n;
+        }
+        s.m_lock.unlock();
+    }
+    return n;
+}
+
+size_t session_store::size()
+{
+    size_t n = 0;
+    for (int i = 0; i < SHARD_COUNT; ++i)
+    {
+        m_shards[i].m_lock.rdlock();
+        n += m_shards[i].m_sessions.size();
+        m_shards[i].m_lock.unlock();
+    }
+    return n;
+}
@@ -0,0 +1,65 @@
+/*************************************************************
+*登录会话：登录成功后发放 Cookie "sid=<token>"，之后带有效 token 的请求不再校验用户名密码
+*token 为 40 个十六进制字符：[会话编号 16][过期时间 8][SipHash-2-4 签名 16]
+*签名密钥在启动时随机生成，伪造或篡改的 token 只需计算一次 SipHash 即可拒绝，不查表；
+*签名有效的 token 还要在会话表中存在，过期的会话由主线程的定时器每个 TIMESLOT 清理一次
+*所有会话的有效期相同，每个分片按创建顺序排队，队首就是最早过期的会话
+**************************************************************/
+
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include "../lock/locker.h"
+
+class session_store
+{
+public:
+    static const int TOKEN_LEN = 40;
+
+    static session_store *get_instance()
+    {
+        static session_store instance;
+        return &instance;
+    }
+
+    //生成签名密钥，ttl 为会话有效期(秒)，0 表示不发放会话
+    bool init(int ttl);
+    bool enabled() { return m_ttl > 0; }
+    int ttl() { return m_ttl; }
+    //为 name 创建会话，token 写入至少 TOKEN_LEN + 1 字节的缓冲
+    bool create(const char *name, char *token);
+    //token 签名正确、未过期且会话仍然存在时返回 true，name 非 NULL 时取出用户名
+    bool check(const char *token, size_t len, std::string *name = NULL);
+    //删除 now 之前过期的会话，返回删除的个数
+    size_t expire(time_t now);
+    size_t size();
+
+private:
+    session_store();
+
+    static const int SHARD_BITS = 4;
+    static const int SHARD_COUNT = 1 << SHARD_BITS;
+
+    struct session_shard
+    {
+        rwlocker m_lock;
+        std::unordered_map<uint64_t, std::string> m_sessions;  //会话编号 -> 用户名
+        std::deque<std::pair<time_t, uint64_t> > m_queue;       //(过期时间, 会话编号)，按创建顺序
+    };
+
+    uint64_t sign(uint64_t id, uint32_t expire);
+    session_shard &shard(uint64_t id) { return m_shards[id & (SHARD_COUNT - 1)]; }
+
+private:
+    int m_ttl;
+    uint64_t m_key[2];
+    uint64_t m_next_id;             //原子递增；token 不可伪造靠签名，编号不必随机
+    session_shard m_shards[SHARD_COUNT];
+};
+
+#endif
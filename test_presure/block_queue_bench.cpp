@@ -0,0 +1,325 @@
+/*************************************************************
+*阻塞队列基准：-p 个生产者向 1 个消费者传递 -n 个元素，比较改写前后的 block_queue
+*  g++ -std=c++20 -O2 -o block_queue_bench block_queue_bench.cpp -lpthread
+*  ./block_queue_bench -p 4 -n 2000000 -s 1024
+*old 为改写前的实现(逐个出队、每次入队 broadcast、按值拷贝)，new 为当前实现(批量出队、按需 signal、移动)
+*元素分别为指针和 64 字节的 std::string
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include "../log/block_queue.h"
+
+//改写前的 block_queue，原样保留用于对比
+template <class T>
+class old_block_queue
+{
+public:
+    //初始化私有成员
+    old_block_queue(int max_size = 1000)
+    {
+        if (max_size <= 0)
+        {
+            exit(-1);
+        }
+        //构造函数创建循环数组
+        m_max_size = max_size;
+        m_array = new T[max_size]; //
+        m_size = 0;
+        m_front = -1;
+        m_back = -1;
+    }
+
+    void clear()
+    {
+        m_mutex.lock();
+        m_size = 0;
+        m_front = -1;
+        m_back = -1;
+        m_mutex.unlock();
+    }
+
+    ~old_block_queue()
+    {
+        m_mutex.lock();
+        if (m_array != NULL)
+            delete [] m_array;
+
+        m_mutex.unlock();
+    }
+    //判断队列是否满了
+    bool full() 
+    {
+        m_mutex.lock();
+        if (m_size >= m_max_size)
+        {
+
+            m_mutex.unlock();
+            return true;
+        }
+        m_mutex.unlock();
+        return false;
+    }
+    //判断队列是否为空
+    bool empty() 
+    {
+        m_mutex.lock();
+        if (0 == m_size)
+        {
+            m_mutex.unlock();
+            return true;
+        }
+        m_mutex.unlock();
+        return false;
+    }
+    //返回队首元素
+    bool front(T &value) 
+    {
+        m_mutex.lock();
+        if (0 == m_size)
+        {
+            m_mutex.unlock();
+            return false;
+        }
+        value = m_array[m_front];
+        m_mutex.unlock();
+        return true;
+    }
+    //返回队尾元素
+    bool back(T &value) 
+    {
+        m_mutex.lock();
+        if (0 == m_size)
+        {
+            m_mutex.unlock();
+            return false;
+        }
+        value = m_array[m_back];
+        m_mutex.unlock();
+        return true;
+    }
+
+    int size() 
+    {
+        int tmp = 0;
+
+        m_mutex.lock();
+        tmp = m_size;
+
+        m_mutex.unlock();
+        return tmp;
+    }
+
+    int max_size()
+    {
+        int tmp = 0;
+
+        m_mutex.lock();
+        tmp = m_max_size;
+
+        m_mutex.unlock();
+        return tmp;
+    }
+    //往队列添加元素，需要将所有使用队列的线程先唤醒
+    //当有元素push进队列,相当于生产者生产了一个元素
+    //若当前没有线程等待条件变量,则唤醒无意义
+    bool push(const T &item)
+    {
+
+        m_mutex.lock();
+        if (m_size >= m_max_size)
+        {
+
+            m_cond.broadcast();
+            m_mutex.unlock();
+            return false;
+        }
+
+        m_back = (m_back + 1) % m_max_size;
+        m_array[m_back] = item;
+
+        m_size++;
+
+        m_cond.broadcast();
+        m_mutex.unlock();
+        return true;
+    }
+    //pop时,如果当前队列没有元素,将会等待条件变量
+    bool pop(T &item)
+    {
+
+        m_mutex.lock();
+        //多个消费者的时候，这里要是用while而不是if
+        while (m_size <= 0)
+        {
+            //当重新抢到互斥锁，pthread_cond_wait返回为0
+            if (!m_cond.wait(m_mutex.get()))
+            {
+                m_mutex.unlock();
+                return false;
+            }
+        }
+//取出队列首的元素，这里需要理解一下，使用循环数组模拟的队列 
+        m_front = (m_front + 1) % m_max_size;
+        item = m_array[m_front];
+        m_size--;
+        m_mutex.unlock();
+        return true;
+    }
+
+    //增加了超时处理
+    bool pop(T &item, int ms_timeout)
+    {
+        struct timespec t = {0, 0};
+        struct timeval now = {0, 0};
+        gettimeofday(&now, NULL);
+        m_mutex.lock();
+        if (m_size <= 0)
+        {
+            t.tv_sec = now.tv_sec + ms_timeout / 1000;
+            t.tv_nsec = (ms_timeout % 1000) * 1000;
+            if (!m_cond.timewait(m_mutex.get(), t))
+            {
+                m_mutex.unlock();
+                return false;
+            }
+        }
+
+        if (m_size <= 0)
+        {
+            m_mutex.unlock();
+            return false;
+        }
+
+        m_front = (m_front + 1) % m_max_size;
+        item = m_array[m_front];
+        m_size--;
+        m_mutex.unlock();
+        return true;
+    }
+
+private:
+    locker m_mutex;   // 已经在 构造函数里面初始化了
+    cond m_cond;
+
+    T *m_array;
+    int m_size;
+    int m_max_size;
+    int m_front;
+    int m_back;
+};
+
+static int producers = 4;
+static long items = 2000000;
+static int queue_size = 1024;
+
+template <class Q, class T>
+struct bench_ctx
+{
+    Q *q;
+    long per_producer;
+    T value;
+};
+
+template <class Q, class T>
+static void *produce(void *arg)
+{
+    bench_ctx<Q, T> *ctx = (bench_ctx<Q, T> *)arg;
+    for (long i = 0; i < ctx->per_producer; ++i)
+    {
+        T v = ctx->value;
+        //队列满时让出 CPU 后重试
+        while (!ctx->q->push(std::move(v)))
+        {
+            sched_yield();
+            v = ctx->value;
+        }
+    }
+    return NULL;
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+//逐个出队
+template <class Q, class T>
+static double run_single(const T &value)
+{
+    Q q(queue_size);
+    bench_ctx<Q, T> ctx = {&q, items / producers, value};
+    long total = ctx.per_producer * producers;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    std::vector<pthread_t> tids(producers);
+    for (int i = 0; i < producers; ++i)
+        pthread_create(&tids[i], NULL, produce<Q, T>, &ctx);
+    T item;
+    for (long i = 0; i < total; ++i)
+        q.pop(item);
+    for (int i = 0; i < producers; ++i)
+        pthread_join(tids[i], NULL);
+    return total / elapsed(start);
+}
+
+//批量出队
+template <class T>
+static double run_batch(const T &value)
+{
+    typedef block_queue<T> Q;
+    Q q(queue_size);
+    bench_ctx<Q, T> ctx = {&q, items / producers, value};
+    long total = ctx.per_producer * producers;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    std::vector<pthread_t> tids(producers);
+    for (int i = 0; i < producers; ++i)
+        pthread_create(&tids[i], NULL, produce<Q, T>, &ctx);
+    std::vector<T> batch(queue_size);
+    for (long got = 0; got < total;)
+        got += q.pop_batch(&batch[0], queue_size);
+    for (int i = 0; i < producers; ++i)
+        pthread_join(tids[i], NULL);
+    return total / elapsed(start);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            producers = atoi(optarg);
+            break;
+        case 'n':
+            items = atol(optarg);
+            break;
+        case 's':
+            queue_size = atoi(optarg);
+            break;
+        }
+    }
+
+    static int dummy;
+    std::string str(64, 'x');
+    printf("producers=%d items=%ld queue=%d (items/s)\n", producers, items, queue_size);
+    printf("pointer  old pop       %12.0f\n", run_single<old_block_queue<int *>, int *>(&dummy));
+    printf("pointer  new pop       %12.0f\n", run_single<block_queue<int *>, int *>(&dummy));
+    printf("pointer  new pop_batch %12.0f\n", run_batch<int *>(&dummy));
+    printf("string   old pop       %12.0f\n", run_single<old_block_queue<std::string>, std::string>(str));
+    printf("string   new pop       %12.0f\n", run_single<block_queue<std::string>, std::string>(str));
+    printf("string   new pop_batch %12.0f\n", run_batch<std::string>(str));
+    return 0;
+}
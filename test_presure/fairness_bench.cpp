@@ -0,0 +1,146 @@
+/*************************************************************
+*大文件与小请求的公平性：-b 个线程不停下载大文件(-B)，同时一个线程循环请求小文件(-s)，
+*统计小请求的延迟分布(每次新建连接，包括连接和读完响应)和大文件的总吞吐
+*用服务器的 -Q 调整每次可写事件的发送配额，对比 -Q 0(写到套接字缓冲区满为止)与默认值
+*  g++ -O2 -o fairness_bench fairness_bench.cpp -lpthread
+*  ./fairness_bench -b 4 -B /huge.bin -s /judge.html -t 10 127.0.0.1 9006
+**************************************************************/
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+static sockaddr_in server_addr;
+static const char *big_url = "/huge.bin";
+static const char *small_url = "/judge.html";
+static volatile bool stop_flag = false;
+
+static long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+//发送一个短连接 GET，读到服务器关闭为止，返回收到的字节数，失败返回 -1
+static long long fetch(const char *url)
+{
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    //结束时不会一直阻塞在 recv 上
+    struct timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    char req[256];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n", url);
+    send(fd, req, n, 0);
+    static thread_local char buf[256 * 1024];
+    long long total = 0;
+    ssize_t r;
+    while (!stop_flag && (r = recv(fd, buf, sizeof(buf), 0)) > 0)
+        total += r;
+    close(fd);
+    return total;
+}
+
+struct bulk_result
+{
+    long long bytes;
+    long long done;
+};
+
+static void *bulk_worker(void *arg)
+{
+    bulk_result *res = (bulk_result *)arg;
+    while (!stop_flag)
+    {
+        long long n = fetch(big_url);
+        if (n < 0)
+            break;
+        res->bytes += n;
+        ++res->done;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int bulk = 4, seconds = 10, opt;
+    while ((opt = getopt(argc, argv, "b:B:s:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            bulk = atoi(optarg);
+            break;
+        case 'B':
+            big_url = optarg;
+            break;
+        case 's':
+            small_url = optarg;
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        printf("usage: %s [-b bulk_clients] [-B big_url] [-s small_url] [-t seconds] ip port\n", argv[0]);
+        return 1;
+    }
+    server_addr.sin_family = AF_INET;
+    inet_pton(AF_INET, argv[optind], &server_addr.sin_addr);
+    server_addr.sin_port = htons(atoi(argv[optind + 1]));
+
+    std::vector<pthread_t> tids(bulk);
+    std::vector<bulk_result> results(bulk);
+    for (int i = 0; i < bulk; ++i)
+    {
+        results[i].bytes = results[i].done = 0;
+        pthread_create(&tids[i], NULL, bulk_worker, &results[i]);
+    }
+    //等大文件下载进入稳定状态
+    usleep(200 * 1000);
+
+    std::vector<long long> lat;
+    long long start = now_us(), end = start + seconds * 1000000LL;
+    int failed = 0;
+    while (now_us() < end)
+    {
+        long long t = now_us();
+        if (fetch(small_url) <= 0)
+            ++failed;
+        else
+            lat.push_back(now_us() - t);
+    }
+    long long elapsed = now_us() - start;
+    stop_flag = true;
+    long long bytes = 0, done = 0;
+    for (int i = 0; i < bulk; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        bytes += results[i].bytes;
+        done += results[i].done;
+    }
+
+    std::sort(lat.begin(), lat.end());
+    size_t n = lat.size();
+    printf("small: %zu requests (%d failed), latency us p50 %lld p90 %lld p99 %lld max %lld\n", n, failed,
+           n ? lat[n / 2] : 0, n ? lat[n * 9 / 10] : 0, n ? lat[n * 99 / 100] : 0, n ? lat[n - 1] : 0);
+    printf("bulk: %d clients, %.1f MB/s, %lld complete downloads\n", bulk, bytes / (elapsed / 1e6) / 1048576, done);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*************************************************************
+*日志微基准：-t 个线程各写 -n 行，统计每秒写入的行数
+*  g++ -std=c++20 -O2 -o log_bench log_bench.cpp ../log/log.cpp ../log/buffer_sink.cpp -lpthread
+*  ./log_bench -t 8 -n 1000000 -q 64      // 异步，64 块每线程缓冲
+*  ./log_bench -t 8 -n 1000000 -q 0       // 同步
+*  ./log_bench -t 8 -n 1000000 -q 64 -b   // 二进制日志
+*  ./log_bench -t 8 -n 1000000 -s 100000  // 每 10 万行切分一次，观察切分时单次调用的最长耗时
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "../log/log.h"
+
+static int lines_per_thread = 1000000;
+static long long max_ns[256];
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *bench_thread(void *arg)
+{
+    long id = (long)arg;
+    long long worst = 0;
+    for (int i = 0; i < lines_per_thread; ++i)
+    {
+        long long start = now_ns();
+        LOG_INFO("deal with the client(%s) fd %d seq %d", "127.0.0.1", (int)id, i);
+        long long cost = now_ns() - start;
+        if (cost > worst)
+            worst = cost;
+    }
+    max_ns[id] = worst;
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = 8, queue = 64, split = 800000000, opt;
+    bool binary = false;
+    while ((opt = getopt(argc, argv, "t:n:q:s:b")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            lines_per_thread = atoi(optarg);
+            break;
+        case 'q':
+            queue = atoi(optarg);
+            break;
+        case 'b':
+            binary = true;
+            break;
+        case 's':
+            split = atoi(optarg);
+            break;
+        }
+    }
+
+    if (threads > 256)
+        threads = 256;
+    Log::get_instance()->init("./log_bench", 2000, split, queue, binary);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t *tids = new pthread_t[threads];
+    for (long i = 0; i < threads; ++i)
+        pthread_create(tids + i, NULL, bench_thread, (void *)i);
+    for (int i = 0; i < threads; ++i)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    long total = (long)threads * lines_per_thread;
+    long long worst = 0;
+    for (int i = 0; i < threads; ++i)
+        worst = max_ns[i] > worst ? max_ns[i] : worst;
+    printf("threads=%d lines=%ld %s%s %.3fs %.0f lines/s max %.1fus\n", threads, total, queue > 0 ? "async" : "sync",
+           binary ? " binary" : "", sec, total / sec, worst / 1000.0);
+    delete[] tids;
+    return 0;
+}
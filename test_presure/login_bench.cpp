@@ -0,0 +1,167 @@
+/*************************************************************
+*登录路径压测：webbench 只能发 GET，这里用 epoll 维持 -c 个长连接，
+*每个连接循环发送 POST /2CGISQL.cgi(或 -r 时的注册请求)，统计每秒完成的请求数
+*-s 时每个连接保存第一次登录得到的会话 Cookie，之后的请求都带上它(服务器不再校验密码)
+*  g++ -O2 -o login_bench login_bench.cpp
+*  ./login_bench -c 1000 -t 10 127.0.0.1 9006
+**************************************************************/
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+struct client
+{
+    int fd;
+    int recv_len;             //当前响应已接收字节数
+    int need;                 //响应总长度，解析出头部之前为 -1
+    char buf[4096];
+    char req[512];
+    int req_len;
+    char sid[64];             //-s 时保存的会话 token
+};
+
+static int bench_connect(const sockaddr_in &addr)
+{
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+//请求很小，一次 send 即可放入套接字缓冲区，因此只监听 EPOLLIN
+static void send_request(client *c, int id, bool reg, long seq)
+{
+    char body[128];
+    int n = snprintf(body, sizeof(body), "user=bench%d_%ld&password=123456", reg ? id : id % 16, reg ? seq : 0);
+    c->req_len = snprintf(c->req, sizeof(c->req),
+                          "POST /%dCGISQL.cgi HTTP/1.1\r\nHost: bench\r\nConnection: keep-alive\r\n"
+                          "%s%s%sContent-length: %d\r\n\r\n%s",
+                          reg ? 3 : 2, c->sid[0] ? "Cookie: sid=" : "", c->sid, c->sid[0] ? "\r\n" : "", n, body);
+    send(c->fd, c->req, c->req_len, 0);
+    c->recv_len = 0;
+    c->need = -1;
+}
+
+int main(int argc, char *argv[])
+{
+    int conns = 100, seconds = 10, opt;
+    bool reg = false, session = false;
+    while ((opt = getopt(argc, argv, "c:t:rs")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            conns = atoi(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'r':
+            reg = true;
+            break;
+        case 's':
+            session = true;
+            break;
+        }
+    }
+    if (optind + 2 > argc)
+    {
+        printf("usage: %s [-c conns] [-t seconds] [-r] [-s] ip port\n", argv[0]);
+        return 1;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, argv[optind], &addr.sin_addr);
+    addr.sin_port = htons(atoi(argv[optind + 1]));
+
+    int epfd = epoll_create(5);
+    client *clients = new client[conns];
+    long seq = 0;
+    for (int i = 0; i < conns; ++i)
+    {
+        clients[i].sid[0] = '\0';
+        clients[i].fd = bench_connect(addr);
+        if (clients[i].fd < 0)
+        {
+            printf("connect failed at %d\n", i);
+            return 1;
+        }
+        //服务器 listen 的 backlog 很小，逐个建连避免全连接队列溢出
+        if (i % 4 == 3)
+            usleep(1000);
+        send_request(&clients[i], i, reg, seq++);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+    }
+
+    long done = 0, failed = 0;
+    epoll_event events[1024];
+    time_t start = time(NULL);
+    while (time(NULL) - start < seconds)
+    {
+        int n = epoll_wait(epfd, events, 1024, 100);
+        for (int k = 0; k < n; ++k)
+        {
+            int i = events[k].data.u32;
+            client *c = &clients[i];
+            if (c->fd < 0)
+                continue;
+            int ret = recv(c->fd, c->buf + c->recv_len, sizeof(c->buf) - 1 - c->recv_len, 0);
+            if (ret <= 0)
+            {
+                if (ret < 0 && errno == EAGAIN)
+                    continue;
+                //服务器关闭了连接，重新建立
+                ++failed;
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, 0);
+                close(c->fd);
+                c->fd = bench_connect(addr);
+                if (c->fd < 0)
+                    continue;
+                send_request(c, i, reg, seq++);
+                epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.u32 = i;
+                epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+                continue;
+            }
+            c->recv_len += ret;
+            c->buf[c->recv_len] = '\0';
+            if (c->need < 0)
+            {
+                char *end = strstr(c->buf, "\r\n\r\n");
+                char *len = strcasestr(c->buf, "Content-Length:");
+                if (!end || !len)
+                    continue;
+                c->need = (end + 4 - c->buf) + atoi(len + 15);
+                char *sid = session && !c->sid[0] ? strcasestr(c->buf, "Set-Cookie:sid=") : NULL;
+                if (sid && sid < end)
+                    sscanf(sid + 15, "%63[0-9a-f]", c->sid);
+            }
+            if (c->recv_len >= c->need)
+            {
+                ++done;
+                send_request(c, i, reg, seq++);
+            }
+        }
+    }
+    printf("conns=%d seconds=%d done=%ld failed=%ld qps=%.0f\n", conns, seconds, done, failed, (double)done / seconds);
+    return 0;
+}
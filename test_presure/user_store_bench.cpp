@@ -0,0 +1,211 @@
+/*************************************************************
+*用户表基准：插入 -n 个合成用户后，-t 个线程并发登录校验，比较 user_store 与 map + 互斥锁
+*  g++ -std=c++20 -O2 -o user_store_bench user_store_bench.cpp ../user/user_store.cpp -lpthread
+*  ./user_store_bench -n 10000000 -t 4 -l 2000000
+*-m 0 不测 map(1000 万用户时 map 占用数 GB 内存)
+*-s file 测试快照的保存和载入，载入后再做一轮校验
+*用户名为 user<i>，密码为 pw<i>；查找的用户随机选取，其中 1/8 使用错误的密码
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "../user/user_store.h"
+
+static long users = 10000000;
+static int threads = 4;
+static long lookups = 2000000;
+static int with_map = 1;
+static const char *snapshot = NULL;
+
+//改写前 http_conn.cpp 中的做法：全局 map，登录时加锁查找(原实现读时不加锁，是数据竞争)
+struct map_store
+{
+    std::map<std::string, std::string> m_users;
+    locker m_lock;
+
+    bool insert_if_absent(const char *name, const char *passwd)
+    {
+        m_lock.lock();
+        bool ok = m_users.insert(std::pair<std::string, std::string>(name, passwd)).second;
+        m_lock.unlock();
+        return ok;
+    }
+    bool check(const char *name, const char *passwd)
+    {
+        m_lock.lock();
+        std::map<std::string, std::string>::iterator it = m_users.find(name);
+        bool ok = it != m_users.end() && it->second == passwd;
+        m_lock.unlock();
+        return ok;
+    }
+};
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+//当前进程的常驻内存，单位 MB
+static double rss_mb()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+template <class S>
+struct lookup_ctx
+{
+    S *store;
+    unsigned int seed;
+    long hits;
+};
+
+template <class S>
+static void *lookup_worker(void *arg)
+{
+    lookup_ctx<S> *ctx = (lookup_ctx<S> *)arg;
+    char name[32], passwd[32];
+    unsigned long long x = ctx->seed * 0x9e3779b97f4a7c15ULL + 1;
+    long hits = 0;
+    for (long i = 0; i < lookups; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        long id = x % users;
+        snprintf(name, sizeof(name), "user%ld", id);
+        snprintf(passwd, sizeof(passwd), (x >> 40) % 8 ? "pw%ld" : "bad%ld", id);
+        hits += ctx->store->check(name, passwd);
+    }
+    ctx->hits = hits;
+    return NULL;
+}
+
+template <class S>
+static void run(const char *label, S *store)
+{
+    double rss = rss_mb();
+    char name[32], passwd[32];
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < users; ++i)
+    {
+        snprintf(name, sizeof(name), "user%ld", i);
+        snprintf(passwd, sizeof(passwd), "pw%ld", i);
+        store->insert_if_absent(name, passwd);
+    }
+    double t = elapsed(start);
+    printf("%-10s insert   %12.0f users/s   rss +%.0f MB\n", label, users / t, rss_mb() - rss);
+
+    for (int n = 1; n <= threads; n *= 2)
+    {
+        std::vector<pthread_t> tids(n);
+        std::vector<lookup_ctx<S> > ctx(n);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < n; ++i)
+        {
+            ctx[i].store = store;
+            ctx[i].seed = i + 1;
+            pthread_create(&tids[i], NULL, lookup_worker<S>, &ctx[i]);
+        }
+        long hits = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            pthread_join(tids[i], NULL);
+            hits += ctx[i].hits;
+        }
+        t = elapsed(start);
+        printf("%-10s check    %12.0f ops/s     threads=%d hit=%.1f%%\n", label, n * lookups / t, n,
+               100.0 * hits / (n * lookups));
+        if (n < threads && n * 2 > threads)
+            n = threads / 2;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:l:m:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            users = atol(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'l':
+            lookups = atol(optarg);
+            break;
+        case 'm':
+            with_map = atoi(optarg);
+            break;
+        case 's':
+            snapshot = optarg;
+            break;
+        }
+    }
+
+    printf("users=%ld threads=%d lookups/thread=%ld\n", users, threads, lookups);
+    {
+        user_store *store = new user_store();
+        run("user_store", store);
+        printf("user_store memory_usage %.0f MB\n", store->memory_usage() / (1024.0 * 1024));
+        if (snapshot)
+        {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            bool ok = store->save_snapshot(snapshot, 0);
+            printf("snapshot   save     %12.0f ms        %s\n", elapsed(start) * 1000, ok ? "ok" : "failed");
+        }
+        delete store;
+    }
+    if (snapshot)
+    {
+        user_store *store = new user_store();
+        long long watermark;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        bool ok = store->load_snapshot(snapshot, &watermark);
+        printf("snapshot   load     %12.2f ms        %zu users\n", elapsed(start) * 1000, ok ? store->size() : 0);
+        for (int n = 1; ok && n <= threads; n *= 2)
+        {
+            std::vector<pthread_t> tids(n);
+            std::vector<lookup_ctx<user_store> > ctx(n);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int i = 0; i < n; ++i)
+            {
+                ctx[i].store = store;
+                ctx[i].seed = i + 1;
+                pthread_create(&tids[i], NULL, lookup_worker<user_store>, &ctx[i]);
+            }
+            for (int i = 0; i < n; ++i)
+                pthread_join(tids[i], NULL);
+            printf("snapshot   check    %12.0f ops/s     threads=%d\n", n * lookups / elapsed(start), n);
+        }
+        delete store;
+    }
+    if (with_map)
+    {
+        map_store *store = new map_store();
+        run("map", store);
+        delete store;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 线程绑核与 NUMA 节点相关的工具函数
+// 内存按"首次写入"分配在写入线程所在的节点上，因此线程先绑核再初始化各自的数据即可得到本地内存
+
+//解析 "0-3,8,10-11" 形式的 CPU 列表
+inline bool parse_cpu_list(const char *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p)
+    {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0 || lo >= CPU_SETSIZE)
+            return false;
+        long hi = lo;
+        p = end;
+        if (*p == '-')
+        {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo || hi >= CPU_SETSIZE)
+                return false;
+            p = end;
+        }
+        for (long i = lo; i <= hi; ++i)
+            CPU_SET(i, set);
+        if (*p == ',')
+            ++p;
+        else if (*p != '\0' && *p != '\n')
+            return false;
+        else
+            break;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+//读取 NUMA 节点包含的 CPU
+inline bool node_cpu_set(int node, cpu_set_t *set)
+{
+    char path[128], buf[1024];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return false;
+    bool ok = fgets(buf, sizeof(buf), fp) && parse_cpu_list(buf, set);
+    fclose(fp);
+    return ok;
+}
+
+//网卡所在的 NUMA 节点，网卡中断和 RSS 队列一般绑定在该节点的 CPU 上；未知时返回 -1
+inline int nic_numa_node(const char *ifname)
+{
+    char path[128];
+    int node = -1;
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifname);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    if (fscanf(fp, "%d", &node) != 1)
+        node = -1;
+    fclose(fp);
+    return node;
+}
+
+//集合中的第 n 个 CPU(循环取)，用于把线程逐个分散到不同的核上
+inline int nth_cpu(const cpu_set_t *set, int n)
+{
+    int count = CPU_COUNT(set);
+    if (count == 0)
+        return -1;
+    n %= count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, set) && n-- == 0)
+            return cpu;
+    }
+    return -1;
+}
+
+inline bool bind_thread(pthread_t tid, const cpu_set_t *set)
+{
+    return pthread_setaffinity_np(tid, sizeof(cpu_set_t), set) == 0;
+}
+
+inline bool bind_thread_to_cpu(pthread_t tid, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return bind_thread(tid, &set);
+}
+
+#endif
@@ -7,22 +7,32 @@
 #include <pthread.h>
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "../coroutine/co_sql.h"
+#include "cpu_affinity.h"
 
 // 线程池类，定义为 模板类，是为了代码复用。
 
 template <typename T>  // T 决定了 请求队列的任务类型
-class threadpool
+class threadpool : public sql_scheduler
 {
 public:
     /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(connection_pool *connPool, int thread_number = 8, int max_request = 10000);
+    /*sql_thread_number>0 时开启协程模式：数据库操作交给专用线程，工作线程不再为每个请求占用数据库连接*/
+    /*actor_model 为 0 时是同步I/O模拟的proactor，为 1 时是reactor：工作线程自己完成读写*/
+    /*conn_affinity 为 true 时工作线程和数据库线程各自独占一条数据库连接，建立失败时才从连接池中取*/
+    threadpool(connection_pool *connPool, int thread_number = 8, int max_request = 10000, int sql_thread_number = 0, int actor_model = 0, bool conn_affinity = false);
     ~threadpool();
-    bool append(T *request);
+    bool append(T *request, int state = 0);     // state 仅在 reactor 模式下使用：0 读事件，1 写事件
+    bool submit(sql_awaiter *job);
+    /*工作线程依次绑定到集合中的各个核上，数据库线程只在该集合内调度*/
+    bool bind_cpus(const cpu_set_t *set);
 
 private:
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void *worker(void *arg);    //注意： work()设置为 静态函数（全局共享，唯一性）
     void run();
+    static void *sql_worker(void *arg);
+    void sql_run();
 
 private:
     int m_thread_number;        //线程池中的线程数
@@ -33,11 +43,18 @@ private:
     sem m_queuestat;            //是否有任务需要处理
     bool m_stop;                //是否结束线程
     connection_pool *m_connPool;  //数据库
+    int m_sql_thread_number;          //数据库线程数，0 表示不开启协程模式
+    int m_actor_model;                //事件处理模式
+    bool m_conn_affinity;             //线程独占数据库连接
+    pthread_t *m_sql_threads;         //数据库线程
+    std::list<sql_awaiter *> m_sqlqueue; //挂起协程提交的数据库任务
+    locker m_sqllocker;
+    sem m_sqlstat;
 };
 template <typename T>
-threadpool<T>::threadpool( connection_pool *connPool, int thread_number, int max_requests) : m_thread_number(thread_number), m_max_requests(max_requests), m_stop(false), m_threads(NULL),m_connPool(connPool)
+threadpool<T>::threadpool( connection_pool *connPool, int thread_number, int max_requests, int sql_thread_number, int actor_model, bool conn_affinity) : m_thread_number(thread_number), m_max_requests(max_requests), m_stop(false), m_threads(NULL),m_connPool(connPool), m_sql_thread_number(sql_thread_number), m_actor_model(actor_model), m_conn_affinity(conn_affinity)
 {
-    if (thread_number <= 0 || max_requests <= 0)
+    if (thread_number <= 0 || max_requests <= 0 || sql_thread_number < 0)
         throw std::exception();
         
     m_threads = new pthread_t[m_thread_number];   // 线程池 就是 线程数组，分别调用 pthread_create
@@ -59,17 +76,28 @@ threadpool<T>::threadpool( connection_pool *connPool, int thread_number, int max
             throw std::exception();
         }
     }
+    m_sql_threads = new pthread_t[sql_thread_number];
+    for (int i = 0; i < sql_thread_number; ++i)
+    {
+        if (pthread_create(m_sql_threads + i, NULL, sql_worker, this) != 0 || pthread_detach(m_sql_threads[i]))
+        {
+            delete[] m_threads;
+            delete[] m_sql_threads;
+            throw std::exception();
+        }
+    }
 }
 
 template <typename T>
 threadpool<T>::~threadpool()
 {
     delete[] m_threads;
+    delete[] m_sql_threads;
     m_stop = true;
 }
 
 template <typename T>
-bool threadpool<T>::append(T *request)
+bool threadpool<T>::append(T *request, int state)
 {
     m_queuelocker.lock();                // 操作队列时，一定要加锁。因为它被所有线程共享。
     if (m_workqueue.size() > m_max_requests)
@@ -77,12 +105,45 @@ bool threadpool<T>::append(T *request)
         m_queuelocker.unlock();
         return false;
     }
+    request->m_state = state;
     m_workqueue.push_back(request);
     m_queuelocker.unlock();
     m_queuestat.post();              //  信号量+1
     return true;
 }
 
+template <typename T>
+bool threadpool<T>::bind_cpus(const cpu_set_t *set)
+{
+    for (int i = 0; i < m_thread_number; ++i)
+    {
+        if (!bind_thread_to_cpu(m_threads[i], nth_cpu(set, i)))
+            return false;
+    }
+    for (int i = 0; i < m_sql_thread_number; ++i)
+    {
+        if (!bind_thread(m_sql_threads[i], set))
+            return false;
+    }
+    return true;
+}
+
+//挂起的协程提交数据库任务，数据库队列与请求队列共用 max_requests 上限
+template <typename T>
+bool threadpool<T>::submit(sql_awaiter *job)
+{
+    m_sqllocker.lock();
+    if (m_sqlqueue.size() > (size_t)m_max_requests)
+    {
+        m_sqllocker.unlock();
+        return false;
+    }
+    m_sqlqueue.push_back(job);
+    m_sqllocker.unlock();
+    m_sqlstat.post();
+    return true;
+}
+
 //类对象传递时用this指针，传递给静态函数后，将其转换为线程池类，并调用私有成员函数run。
 template <typename T>
 void *threadpool<T>::worker(void *arg)   // 静态成员函数，所有对象共享
@@ -97,6 +158,7 @@ void threadpool<T>::run()
     // 解决 高并发
     // 通过while循环让每一个线程池中的线程都不会终止，
     // 说白了就是让他处理完当前任务就去处理下一个，没有任务就一直阻塞在那里等待
+    threadConnection own(m_conn_affinity ? m_connPool : NULL);
     while (!m_stop)
     {
         m_queuestat.wait();         // 信号量-1
@@ -117,9 +179,100 @@ void threadpool<T>::run()
         if (!request)
             continue;
 
+        //数据库任务完成后被放回队列的请求，从挂起点继续执行
+        if (request->m_co_handle)
+        {
+            std::coroutine_handle<> h = request->m_co_handle;
+            request->m_co_handle = nullptr;
+            h.resume();
+            continue;
+        }
+
+        //处理期间主线程对该连接的关闭(如定时器超时)推迟到 end_task，连接对象不会被新连接复用；
+        //process 自行结束任务
+        request->begin_task();
+
+        //reactor 模式：主线程只分发就绪事件，读写由工作线程完成
+        //失败时通知主线程关闭连接，定时器链表只由主线程操作
+        if (1 == m_actor_model)
+        {
+            if (1 == request->m_state)
+            {
+                if (!request->write())
+                    request->notify_close();
+                request->end_task();
+                continue;
+            }
+            if (!request->read_once())
+            {
+                request->notify_close();
+                request->end_task();
+                continue;
+            }
+        }
+
+        if (m_sql_thread_number > 0)
+        {
+            request->process();
+            continue;
+        }
+        //独占连接可用时不经过连接池
+        if ((request->mysql = own.Get()) != NULL)
+        {
+            request->process();
+            own.Release();
+            continue;
+        }
         connectionRAII mysqlcon(&request->mysql, m_connPool);      //从连接池中取出一个数据库连接
         
         request->process();
     }
 }
+
+template <typename T>
+void *threadpool<T>::sql_worker(void *arg)
+{
+    threadpool *pool = (threadpool *)arg;
+    pool->sql_run();
+    return pool;
+}
+
+//数据库线程：独占阻塞等待数据库往返，挂起的请求数不受工作线程数限制
+template <typename T>
+void threadpool<T>::sql_run()
+{
+    threadConnection own(m_conn_affinity ? m_connPool : NULL);
+    while (!m_stop)
+    {
+        m_sqlstat.wait();
+        m_sqllocker.lock();
+        if (m_sqlqueue.empty())
+        {
+            m_sqllocker.unlock();
+            continue;
+        }
+        sql_awaiter *job = m_sqlqueue.front();
+        m_sqlqueue.pop_front();
+        m_sqllocker.unlock();
+
+        T *request = (T *)job->owner();
+        if (MYSQL *mysql = own.Get())
+        {
+            job->run(mysql);
+            own.Release();
+        }
+        else
+        {
+            connectionRAII mysqlcon(&mysql, m_connPool);
+            job->run(mysql);
+        }
+        //job 位于协程帧中，恢复之后即失效，先取出句柄
+        //恢复的请求不受 max_requests 限制，否则挂起的协程会丢失
+        request->m_co_handle = job->handle();
+        m_queuelocker.lock();
+        m_workqueue.push_back(request);
+        m_queuelocker.unlock();
+        m_queuestat.post();
+    }
+}
 #endif
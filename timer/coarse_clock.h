@@ -0,0 +1,43 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <time.h>
+#include <sys/time.h>
+
+// 定时器和日志共用的时钟源，经 vDSO 读取，不进入内核
+// now_sec/monotonic_sec 读 *_COARSE 时钟(精度为一个时钟节拍)；precise_now/monotonic_us 需要微秒，读精确时钟
+class coarse_clock
+{
+public:
+    //秒级时间，精度为一个时钟节拍，用于定时器的超时计算
+    static time_t now_sec()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return ts.tv_sec;
+    }
+    //微秒精度的当前时间，用于日志时间戳；粗时钟的节拍级精度不够，读精确的 CLOCK_REALTIME
+    static void precise_now(struct timeval *tv)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = ts.tv_nsec / 1000;
+    }
+    //秒级单调时间，不受系统时间调整影响，用于每次请求都要判断的长间隔(如连接空闲)
+    static time_t monotonic_sec()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec;
+    }
+    //单调时钟的微秒数，只用于计算耗时
+    static long long monotonic_us()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define LST_TIMER
 
 #include <time.h>
+#include "coarse_clock.h"
 #include "../log/log.h"
 
 // 升序链表的定时器（双向链表）
@@ -135,11 +136,10 @@ public:
             return;
         }
 
-        LOG_INFO("%s", "timer tick");
-        Log::get_instance()->flush();
+        LOG_DEBUG("%s", "timer tick");
 
         // 获得 系统的当前时间
-        time_t cur = time(NULL);            
+        time_t cur = coarse_clock::now_sec();            
         util_timer *tmp = head;    
        // 遍历，从 头节点 开始处理定时器，直到遇到一个未超时的
         while (tmp)
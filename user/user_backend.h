@@ -0,0 +1,32 @@
+/*************************************************************
+*用户表的存储后端：登录只查 user_store，后端负责启动时载入全部用户、注册时持久化新用户
+*  user_mysql   MySQL，经连接池读写，可选快照(-U)与注册写回日志(-J)
+*  user_sqlite  嵌入式 SQLite 数据库文件，不经网络
+*  user_local   不依赖数据库：mmap 快照 + 追加日志，日志过长时在后台合并进快照
+*启动时用 -B 选择，非 MySQL 后端不创建数据库连接池
+**************************************************************/
+
+#ifndef USER_BACKEND_H
+#define USER_BACKEND_H
+
+#include <mysql/mysql.h>
+#include "user_store.h"
+
+class user_backend
+{
+public:
+    virtual ~user_backend() {}
+
+    virtual const char *name() = 0;
+    //把已有用户载入 user_store，需在服务开始前调用
+    virtual bool load(user_store *users) = 0;
+    //持久化一个已在 user_store 中占住的新用户，成功返回 0
+    //need_conn() 为 true 时 conn 是数据库线程或工作线程取得的连接，否则为 NULL
+    virtual int insert(const char *name, const char *passwd, MYSQL *conn) = 0;
+    //insert 是否需要数据库连接；需要时注册以协程方式提交到数据库线程
+    virtual bool need_conn() { return false; }
+    //退出前写完未持久化的数据
+    virtual void stop() {}
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "user_journal.h"
+#include "user_store.h"
+#include "../log/log.h"
+
+user_journal::user_journal()
+{
+    m_fd = -1;
+    m_end = 0;
+    m_done = 0;
+    m_waiting = false;
+    m_stop = false;
+    m_started = false;
+    m_pool = NULL;
+    m_batch = MAX_BATCH;
+    m_rows = 0;
+    m_batches = 0;
+}
+
+user_journal::~user_journal()
+{
+    stop();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+int user_journal::parse_record(const char *buf, size_t len, char *name, char *passwd)
+{
+    if (len < 2)
+        return 0;
+    int nl = (unsigned char)buf[0], pl = (unsigned char)buf[1];
+    if (len < (size_t)(2 + nl + pl))
+        return 0;
+    memcpy(name, buf + 2, nl);
+    name[nl] = '\0';
+    memcpy(passwd, buf + 2 + nl, pl);
+    passwd[pl] = '\0';
+    return 2 + nl + pl;
+}
+
+static bool pread_all(int fd, char *buf, size_t len, off_t off)
+{
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, buf, len, off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return true;
+}
+
+long long user_journal::replay(int fd, user_store *users, off_t *end)
+{
+    char buf[64 * 1024];
+    char name[256], passwd[256];
+    off_t off = 0;
+    size_t have = 0;
+    long long count = 0;
+    ssize_t n;
+    while ((n = pread(fd, buf + have, sizeof(buf) - have, off + have)) > 0)
+    {
+        have += n;
+        size_t pos = 0;
+        int len;
+        while ((len = parse_record(buf + pos, have - pos, name, passwd)) > 0)
+        {
+            users->insert_if_absent(name, passwd);
+            pos += len;
+            ++count;
+        }
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+        off += pos;
+    }
+    //崩溃时写了一半的记录丢弃，这次注册没有返回成功
+    if (n < 0 || (have > 0 && ftruncate(fd, off) != 0))
+        return -1;
+    *end = off;
+    return count;
+}
+
+bool user_journal::init(const char *path, connection_pool *pool, int batch)
+{
+    m_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (m_fd < 0)
+        return false;
+    m_pool = pool;
+    m_batch = batch < 1 ? 1 : (batch > MAX_BATCH ? MAX_BATCH : batch);
+
+    //上次没有写入数据库的注册先放回 user_store，写回线程从头补写(INSERT IGNORE 跳过已写入的行)
+    off_t off;
+    long long pending = replay(m_fd, user_store::get_instance(), &off);
+    if (pending < 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_end = off;
+    m_done = 0;
+
+    if (pthread_create(&m_tid, NULL, worker, this) != 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_started = true;
+    LOG_INFO("user journal %s: %lld pending users", path, pending);
+    return true;
+}
+
+int user_journal::encode_record(char *rec, const char *name, const char *passwd)
+{
+    size_t nl = strlen(name), pl = strlen(passwd);
+    if (nl > 255 || pl > 255)
+        return -1;
+    rec[0] = nl;
+    rec[1] = pl;
+    memcpy(rec + 2, name, nl);
+    memcpy(rec + 2 + nl, passwd, pl);
+    return 2 + nl + pl;
+}
+
+bool user_journal::append(const char *name, const char *passwd)
+{
+    char rec[RECORD_MAX];
+    ssize_t len = encode_record(rec, name, passwd);
+    if (m_fd < 0 || len < 0)
+        return false;
+
+    m_lock.lock();
+    ssize_t n = write(m_fd, rec, len);
+    bool ok = n == len;
+    if (ok)
+    {
+        m_end += len;
+        if (m_waiting)
+            m_cond.signal();
+    }
+    else if (n > 0 && ftruncate(m_fd, m_end) != 0)
+        LOG_ERROR("%s", "user journal truncate failed");
+    m_lock.unlock();
+    return ok;
+}
+
+void user_journal::stop()
+{
+    if (!m_started)
+        return;
+    m_lock.lock();
+    m_stop = true;
+    m_cond.signal();
+    m_lock.unlock();
+    pthread_join(m_tid, NULL);
+    m_started = false;
+    LOG_INFO("user journal stopped: %lld users in %lld batches", m_rows, m_batches);
+}
+
+void *user_journal::worker(void *arg)
+{
+    ((user_journal *)arg)->run();
+    return NULL;
+}
+
+void user_journal::run()
+{
+    while (true)
+    {
+        m_lock.lock();
+        while (m_done == m_end && !m_stop)
+        {
+            m_waiting = true;
+            m_cond.wait(m_lock.get());
+            m_waiting = false;
+        }
+        if (m_done == m_end)
+        {
+            m_lock.unlock();
+            break;
+        }
+        off_t end = m_end;
+        m_lock.unlock();
+
+        //写入数据库期间到达的注册会在下一批一起写入，吞吐随数据库往返时间增加而增加批量
+        long n = flush_batch(end);
+        if (n < 0)
+        {
+            if (m_stop)
+                break;
+            //数据库不可用，1 秒后重试
+            struct timespec t;
+            clock_gettime(CLOCK_REALTIME, &t);
+            t.tv_sec += 1;
+            m_lock.lock();
+            if (!m_stop)
+                m_cond.timewait(m_lock.get(), t);
+            m_lock.unlock();
+            continue;
+        }
+
+        m_lock.lock();
+        m_done += n;
+        //全部写入后截断日志，append 也持有 m_lock，不会丢失记录
+        if (m_done == m_end && ftruncate(m_fd, 0) == 0)
+            m_end = m_done = 0;
+        m_lock.unlock();
+    }
+}
+
+long user_journal::flush_batch(off_t end)
+{
+    char buf[MAX_BATCH * RECORD_MAX];
+    char names[MAX_BATCH][256], passwds[MAX_BATCH][256];
+    const char *name_ptr[MAX_BATCH], *passwd_ptr[MAX_BATCH];
+
+    size_t want = end - m_done;
+    if (want > sizeof(buf))
+        want = sizeof(buf);
+    if (!pread_all(m_fd, buf, want, m_done))
+    {
+        LOG_ERROR("%s", "user journal read failed");
+        return -1;
+    }
+    int rows = 0;
+    size_t pos = 0;
+    int len;
+    while (rows < m_batch && (len = parse_record(buf + pos, want - pos, names[rows], passwds[rows])) > 0)
+    {
+        name_ptr[rows] = names[rows];
+        passwd_ptr[rows] = passwds[rows];
+        pos += len;
+        ++rows;
+    }
+    if (rows == 0)
+    {
+        LOG_ERROR("%s", "user journal corrupted");
+        return -1;
+    }
+
+    //写数据库前把日志落盘，一次 fdatasync 覆盖这段时间内的全部注册
+    fdatasync(m_fd);
+
+    MYSQL *conn = NULL;
+    connectionRAII mysqlcon(&conn, m_pool);
+    if (!conn || !insert_rows(conn, name_ptr, passwd_ptr, rows))
+        return -1;
+    m_rows += rows;
+    ++m_batches;
+    LOG_DEBUG("user journal flushed %d users", rows);
+    return pos;
+}
+
+//行数按二进制位拆成 64/32/.../1 行的预编译语句，每种语句每条连接只 prepare 一次
+bool user_journal::insert_rows(MYSQL *conn, const char **names, const char **passwds, int n)
+{
+    MYSQL_BIND bind[2 * MAX_BATCH];
+    unsigned long lens[2 * MAX_BATCH];
+    int done = 0;
+    for (int k = STMT_INSERT_USERS_64 - STMT_INSERT_USERS_1; k >= 0; --k)
+    {
+        int rows = 1 << k;
+        if (!(n & rows))
+            continue;
+        MYSQL_STMT *stmt = m_pool->GetStatement(conn, (SQL_STMT)(STMT_INSERT_USERS_1 + k));
+        if (!stmt)
+        {
+            LOG_ERROR("prepare error:%s", mysql_error(conn));
+            return false;
+        }
+        memset(bind, 0, sizeof(MYSQL_BIND) * 2 * rows);
+        for (int i = 0; i < rows; ++i)
+        {
+            const char *field[2] = {names[done + i], passwds[done + i]};
+            for (int f = 0; f < 2; ++f)
+            {
+                MYSQL_BIND &b = bind[2 * i + f];
+                lens[2 * i + f] = strlen(field[f]);
+                b.buffer_type = MYSQL_TYPE_STRING;
+                b.buffer = (void *)field[f];
+                b.buffer_length = lens[2 * i + f];
+                b.length = &lens[2 * i + f];
+            }
+        }
+        if (mysql_stmt_bind_param(stmt, bind) || mysql_stmt_execute(stmt))
+        {
+            LOG_ERROR("INSERT error:%s", mysql_stmt_error(stmt));
+            return false;
+        }
+        done += rows;
+    }
+    return true;
+}
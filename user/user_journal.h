@@ -0,0 +1,71 @@
+/*************************************************************
+*注册写回：新用户先进入 user_store 并追加到本地日志文件，立即返回注册成功，
+*后台线程从日志中按顺序读出记录，攒成多行 INSERT IGNORE 写入数据库
+*日志文件本身就是待写队列：全部写入数据库后截断为空，
+*进程崩溃后重启时先把日志中的用户放回 user_store，再由后台线程补写
+*记录格式：[name_len:1][passwd_len:1][name][passwd]
+**************************************************************/
+
+#ifndef USER_JOURNAL_H
+#define USER_JOURNAL_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include "../lock/locker.h"
+#include "../CGImysql/sql_connection_pool.h"
+
+class user_store;
+
+class user_journal
+{
+public:
+    static const int MAX_BATCH = 64;        //与最大的批量插入语句 STMT_INSERT_USERS_64 一致
+    static const int RECORD_MAX = 2 + 255 + 255;
+
+    //编码一条记录，返回长度，用户名或密码超过 255 字节时返回 -1
+    static int encode_record(char *rec, const char *name, const char *passwd);
+    //解析 buf 开头的一条记录，不完整时返回 0；name 和 passwd 至少 256 字节
+    static int parse_record(const char *buf, size_t len, char *name, char *passwd);
+    //把 fd 中的全部记录放回 users，截掉末尾不完整的记录，返回记录数并在 end 中给出有效长度，出错返回 -1
+    static long long replay(int fd, user_store *users, off_t *end);
+
+    static user_journal *get_instance()
+    {
+        static user_journal instance;
+        return &instance;
+    }
+
+    //打开日志并启动写回线程，需在载入用户表之后调用；batch 为单次 INSERT 的最大行数
+    bool init(const char *path, connection_pool *pool, int batch = MAX_BATCH);
+    bool enabled() { return m_fd >= 0; }
+    //追加一条注册记录，返回 true 后即使进程崩溃，下次启动也会写入数据库
+    bool append(const char *name, const char *passwd);
+    //写完日志中剩余的记录后结束写回线程；数据库不可用时放弃，留待下次启动
+    void stop();
+
+private:
+    user_journal();
+    ~user_journal();
+    static void *worker(void *arg);
+    void run();
+    //读出 [m_done, end) 中最多 m_batch 条记录写入数据库，返回消耗的字节数，失败返回 -1
+    long flush_batch(off_t end);
+    bool insert_rows(MYSQL *conn, const char **names, const char **passwds, int n);
+
+private:
+    locker m_lock;
+    cond m_cond;
+    int m_fd;
+    off_t m_end;            //已追加的字节数，m_lock 保护
+    off_t m_done;           //已写入数据库的字节数，只由写回线程修改
+    bool m_waiting;         //写回线程正在等待新记录
+    bool m_stop;
+    bool m_started;
+    pthread_t m_tid;
+    connection_pool *m_pool;
+    int m_batch;
+    long long m_rows;       //统计：写入的行数和批次
+    long long m_batches;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "user_local.h"
+#include "user_journal.h"
+#include "../log/log.h"
+#include "../timer/coarse_clock.h"
+
+user_local::user_local(const char *path, long long compact_bytes)
+    : m_snap_path(std::string(path) + ".snap"), m_log_path(std::string(path) + ".log")
+{
+    m_compact_bytes = compact_bytes;
+    m_users = NULL;
+    m_fd = -1;
+    m_end = 0;
+    m_dirty = false;
+    m_stop = false;
+    m_started = false;
+}
+
+user_local::~user_local()
+{
+    stop();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool user_local::load(user_store *users)
+{
+    long long start = coarse_clock::monotonic_us();
+    m_users = users;
+    //快照存在却载入失败时不能继续：之后的合并会用不完整的用户表覆盖它
+    long long watermark;
+    if (access(m_snap_path.c_str(), F_OK) == 0 && !users->load_snapshot(m_snap_path.c_str(), &watermark))
+    {
+        LOG_ERROR("load user snapshot %s failed", m_snap_path.c_str());
+        return false;
+    }
+
+    m_fd = open(m_log_path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (m_fd < 0)
+    {
+        LOG_ERROR("open %s: %s", m_log_path.c_str(), strerror(errno));
+        return false;
+    }
+    long long records = user_journal::replay(m_fd, users, &m_end);
+    if (records < 0)
+    {
+        LOG_ERROR("read %s failed", m_log_path.c_str());
+        return false;
+    }
+
+    if (pthread_create(&m_tid, NULL, worker, this) != 0)
+        return false;
+    m_started = true;
+    LOG_INFO("loaded %zu users (%zu from snapshot, %lld log records) in %lld ms", users->size(), users->snapshot_size(),
+             records, (coarse_clock::monotonic_us() - start) / 1000);
+    return true;
+}
+
+int user_local::insert(const char *name, const char *passwd, MYSQL *)
+{
+    char rec[user_journal::RECORD_MAX];
+    int len = user_journal::encode_record(rec, name, passwd);
+    if (len < 0)
+        return 1;
+
+    m_lock.lock();
+    ssize_t n = m_fd >= 0 ? write(m_fd, rec, len) : -1;
+    bool ok = n == len;
+    if (ok)
+    {
+        m_end += len;
+        m_dirty = true;
+    }
+    else if (n > 0 && ftruncate(m_fd, m_end) != 0)
+        LOG_ERROR("%s", "user log truncate failed");
+    m_lock.unlock();
+    return ok ? 0 : 1;
+}
+
+void user_local::stop()
+{
+    if (!m_started)
+        return;
+    m_lock.lock();
+    m_stop = true;
+    m_cond.signal();
+    m_lock.unlock();
+    pthread_join(m_tid, NULL);
+    m_started = false;
+    fdatasync(m_fd);
+}
+
+void *user_local::worker(void *arg)
+{
+    ((user_local *)arg)->run();
+    return NULL;
+}
+
+//每秒把新记录落盘一次，日志过长时合并进快照；m_fd 只在本线程中被替换
+void user_local::run()
+{
+    long long limit = m_compact_bytes;
+    m_lock.lock();
+    while (!m_stop)
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += 1;
+        m_cond.timewait(m_lock.get(), t);
+        bool sync = m_dirty;
+        m_dirty = false;
+        off_t end = m_end;
+        m_lock.unlock();
+
+        if (sync)
+            fdatasync(m_fd);
+        if (end >= limit)
+            //合并失败时等日志再增长 compact_bytes 后重试，不每秒重写一次快照
+            limit = compact() ? m_compact_bytes : end + m_compact_bytes;
+
+        m_lock.lock();
+    }
+    m_lock.unlock();
+}
+
+bool user_local::compact()
+{
+    long long start = coarse_clock::monotonic_us();
+    m_lock.lock();
+    off_t cut = m_end;
+    m_lock.unlock();
+
+    //快照包含开始保存时 user_store 中的全部用户，日志 [0, cut) 中的用户都已在其中
+    if (!m_users->save_snapshot(m_snap_path.c_str(), 0))
+    {
+        LOG_ERROR("save user snapshot %s failed", m_snap_path.c_str());
+        return false;
+    }
+
+    std::string tmp = m_log_path + ".tmp";
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR("open %s: %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+
+    //快照期间新增的记录拷入新日志；崩溃在替换之前时旧日志仍然完整，重放会跳过快照中已有的用户
+    m_lock.lock();
+    char buf[64 * 1024];
+    bool ok = true;
+    for (off_t off = cut; ok && off < m_end;)
+    {
+        size_t want = m_end - off < (off_t)sizeof(buf) ? m_end - off : sizeof(buf);
+        ssize_t n = pread(m_fd, buf, want, off);
+        ok = n > 0 && write(fd, buf, n) == n;
+        off += n;
+    }
+    ok = ok && fdatasync(fd) == 0 && rename(tmp.c_str(), m_log_path.c_str()) == 0;
+    off_t left = m_end - cut;
+    if (ok)
+    {
+        close(m_fd);
+        m_fd = fd;
+        m_end = left;
+        m_dirty = false;
+    }
+    m_lock.unlock();
+
+    if (!ok)
+    {
+        LOG_ERROR("replace %s failed", m_log_path.c_str());
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    LOG_INFO("user log compacted: %zu users in snapshot, %lld bytes kept, %lld ms", m_users->size(), (long long)left,
+             (coarse_clock::monotonic_us() - start) / 1000);
+    return true;
+}
@@ -0,0 +1,51 @@
+/*************************************************************
+*本地引擎：不依赖任何数据库，用户表由两个文件组成
+*  <path>.snap  user_store 快照，启动时直接 mmap 为基础层
+*  <path>.log   快照之后注册的用户，记录格式与 user_journal 相同
+*注册只 write 一条日志记录(进程崩溃不丢)，后台线程每秒 fdatasync 一次(掉电最多丢失 1 秒)
+*日志超过 compact_bytes 时后台重写快照，再把快照期间新增的记录拷入新日志替换旧日志
+**************************************************************/
+
+#ifndef USER_LOCAL_H
+#define USER_LOCAL_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <string>
+#include "user_backend.h"
+#include "../lock/locker.h"
+
+class user_local : public user_backend
+{
+public:
+    user_local(const char *path, long long compact_bytes = 64 << 20);
+    ~user_local();
+
+    const char *name() { return "local"; }
+    //映射快照、重放日志并启动后台线程
+    bool load(user_store *users);
+    int insert(const char *name, const char *passwd, MYSQL *conn);
+    void stop();
+
+private:
+    static void *worker(void *arg);
+    void run();
+    bool compact();
+
+private:
+    std::string m_snap_path;
+    std::string m_log_path;
+    long long m_compact_bytes;
+    user_store *m_users;
+
+    locker m_lock;          //保护 m_fd、m_end、m_dirty，替换日志期间注册会等待
+    cond m_cond;
+    int m_fd;
+    off_t m_end;            //日志长度
+    bool m_dirty;           //有未 fdatasync 的记录
+    bool m_stop;
+    bool m_started;
+    pthread_t m_tid;
+};
+
+#endif
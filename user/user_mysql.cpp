@@ -0,0 +1,239 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+#include "user_mysql.h"
+#include "user_journal.h"
+#include "../log/log.h"
+#include "../timer/coarse_clock.h"
+
+//快照的进度之前再重读这么多行：自增 id 的提交顺序不一定与分配顺序一致，保存快照时较小的 id 可能还未提交
+static const long long SNAPSHOT_OVERLAP = 10000;
+
+//一个分段：在独立的连接上执行 m_sql，逐行插入 user_store
+struct user_load_part
+{
+    connection_pool *m_pool;
+    char m_sql[128];
+    long long m_rows;       //读到的行数，出错时为 -1
+    long long m_added;      //其中新加入的用户
+};
+
+static void *load_user_part(void *arg)
+{
+    user_load_part *part = (user_load_part *)arg;
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, part->m_pool);
+    if (!mysql || mysql_query(mysql, part->m_sql))
+    {
+        LOG_ERROR("SELECT error:%s", mysql ? mysql_error(mysql) : "no connection");
+        part->m_rows = -1;
+        return NULL;
+    }
+
+    //mysql_use_result 逐行从网络读取，不在客户端缓存整张表
+    MYSQL_RES *result = mysql_use_result(mysql);
+    if (!result)
+    {
+        LOG_ERROR("SELECT error:%s", mysql_error(mysql));
+        part->m_rows = -1;
+        return NULL;
+    }
+    user_store *users = user_store::get_instance();
+    while (MYSQL_ROW row = mysql_fetch_row(result))
+    {
+        if (row[0] && row[1] && users->insert_if_absent(row[0], row[1]))
+            ++part->m_added;
+        ++part->m_rows;
+    }
+    mysql_free_result(result);
+    return NULL;
+}
+
+//user 表有自增列 id 时返回 true 并给出其范围；表为空时 *hi < *lo
+static bool query_id_range(connection_pool *connPool, long long *lo, long long *hi)
+{
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, connPool);
+    if (!mysql || mysql_query(mysql, "SELECT MIN(id),MAX(id) FROM user"))
+        return false;
+    MYSQL_RES *result = mysql_store_result(mysql);
+    if (!result)
+        return false;
+    MYSQL_ROW row = mysql_fetch_row(result);
+    *lo = 0;
+    *hi = -1;
+    if (row && row[0] && row[1])
+    {
+        *lo = atoll(row[0]);
+        *hi = atoll(row[1]);
+    }
+    mysql_free_result(result);
+    return true;
+}
+
+static std::string g_snapshot_path;
+static long long g_snapshot_watermark;
+static user_store *g_snapshot_users;
+
+static void *save_user_snapshot(void *)
+{
+    if (g_snapshot_users->save_snapshot(g_snapshot_path.c_str(), g_snapshot_watermark))
+        LOG_INFO("user snapshot saved: %s", g_snapshot_path.c_str());
+    else
+        LOG_ERROR("save user snapshot %s failed", g_snapshot_path.c_str());
+    return NULL;
+}
+
+//用预编译语句插入新用户，参数按二进制绑定，不拼接 SQL；成功返回 0
+static int insert_user(connection_pool *connPool, MYSQL *conn, const char *name, const char *passwd)
+{
+    MYSQL_STMT *stmt = conn ? connPool->GetStatement(conn, STMT_INSERT_USER) : NULL;
+    if (!stmt)
+    {
+        LOG_ERROR("prepare error:%s", conn ? mysql_error(conn) : "no connection");
+        return 1;
+    }
+    unsigned long name_len = strlen(name), passwd_len = strlen(passwd);
+    MYSQL_BIND bind[2];
+    memset(bind, 0, sizeof(bind));
+    bind[0].buffer_type = MYSQL_TYPE_STRING;
+    bind[0].buffer = (void *)name;
+    bind[0].buffer_length = name_len;
+    bind[0].length = &name_len;
+    bind[1].buffer_type = MYSQL_TYPE_STRING;
+    bind[1].buffer = (void *)passwd;
+    bind[1].buffer_length = passwd_len;
+    bind[1].length = &passwd_len;
+    if (mysql_stmt_bind_param(stmt, bind) || mysql_stmt_execute(stmt))
+    {
+        LOG_ERROR("INSERT error:%s", mysql_stmt_error(stmt));
+        return 1;
+    }
+    return 0;
+}
+
+//载入后在后台重写快照；读取数据库出错时返回 false
+static bool load_users(connection_pool *connPool, user_store *users, int load_threads, const char *snapshot)
+{
+    long long start = coarse_clock::monotonic_us();
+
+    //有自增列 id 时按 id 范围分段，快照记录已载入的最大 id；没有时按用户名的 CRC32 分段全量载入，不使用快照
+    long long lo = 0, hi = -1;
+    bool has_id = query_id_range(connPool, &lo, &hi);
+    long long watermark = 0;
+    bool from_snapshot = false;
+    if (snapshot && !has_id)
+        LOG_WARN("%s", "user table has no AUTO_INCREMENT id column, snapshot disabled");
+    else if (snapshot && users->load_snapshot(snapshot, &watermark))
+    {
+        from_snapshot = true;
+        if (watermark - SNAPSHOT_OVERLAP + 1 > lo)
+            lo = watermark - SNAPSHOT_OVERLAP + 1;
+    }
+
+    int parts = load_threads;
+    if (parts > connPool->GetFreeConn())
+        parts = connPool->GetFreeConn();
+    if (has_id && hi - lo + 1 < parts)
+        parts = hi >= lo ? hi - lo + 1 : 0;
+    if (parts < 1 && !has_id)
+        parts = 1;
+
+    vector<user_load_part> tasks(parts > 0 ? parts : 0);
+    for (int i = 0; i < parts; ++i)
+    {
+        tasks[i].m_pool = connPool;
+        tasks[i].m_rows = 0;
+        tasks[i].m_added = 0;
+        if (has_id)
+        {
+            long long step = (hi - lo + 1) / parts;
+            long long a = lo + step * i;
+            long long b = i == parts - 1 ? hi : a + step - 1;
+            snprintf(tasks[i].m_sql, sizeof(tasks[i].m_sql), "SELECT username,passwd FROM user WHERE id BETWEEN %lld AND %lld", a, b);
+        }
+        else if (parts > 1)
+            snprintf(tasks[i].m_sql, sizeof(tasks[i].m_sql), "SELECT username,passwd FROM user WHERE CRC32(username) %% %d = %d", parts, i);
+        else
+            strcpy(tasks[i].m_sql, "SELECT username,passwd FROM user");
+    }
+    if (has_id && hi >= lo)
+        users->reserve(hi - lo + 1);
+
+    //分片各有一把锁，多个线程同时插入不会互相阻塞
+    vector<pthread_t> tids(parts > 1 ? parts : 0);
+    for (int i = 1; i < parts; ++i)
+        if (pthread_create(&tids[i], NULL, load_user_part, &tasks[i]) != 0)
+        {
+            tids[i] = 0;
+            load_user_part(&tasks[i]);
+        }
+    if (parts > 0)
+        load_user_part(&tasks[0]);
+    for (int i = 1; i < parts; ++i)
+        if (tids[i])
+            pthread_join(tids[i], NULL);
+
+    long long rows = 0, added = 0;
+    bool ok = true;
+    for (int i = 0; i < parts; ++i)
+    {
+        if (tasks[i].m_rows < 0)
+            ok = false;
+        else
+            rows += tasks[i].m_rows;
+        added += tasks[i].m_added;
+    }
+    LOG_INFO("loaded %zu users (%zu from snapshot, %lld of %lld rows from mysql in %d parts) in %lld ms",
+             users->size(), users->snapshot_size(), added, rows, parts, (coarse_clock::monotonic_us() - start) / 1000);
+
+    //有新用户或还没有快照时重写快照；保存期间注册会等待，所以放在后台
+    if (snapshot && has_id && ok && (!from_snapshot || added > 0))
+    {
+        g_snapshot_path = snapshot;
+        g_snapshot_users = users;
+        g_snapshot_watermark = hi > watermark ? hi : watermark;
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, save_user_snapshot, NULL) == 0)
+            pthread_detach(tid);
+    }
+    return ok;
+}
+
+user_mysql::user_mysql(connection_pool *pool, int load_threads, const char *snapshot, const char *journal)
+{
+    m_pool = pool;
+    m_load_threads = load_threads;
+    m_snapshot = snapshot;
+    m_journal = journal;
+}
+
+//数据库暂时不可用时只记录错误，服务照常启动；写回日志打不开时返回 false
+bool user_mysql::load(user_store *users)
+{
+    if (!load_users(m_pool, users, m_load_threads, m_snapshot))
+        LOG_ERROR("%s", "load users from mysql failed");
+    //写回日志中上次没有写入数据库的用户在 init 中放回 user_store
+    return !m_journal || user_journal::get_instance()->init(m_journal, m_pool);
+}
+
+int user_mysql::insert(const char *name, const char *passwd, MYSQL *conn)
+{
+    //写回模式：记入本地日志即返回成功，由后台线程批量写入数据库
+    if (user_journal::get_instance()->enabled())
+        return user_journal::get_instance()->append(name, passwd) ? 0 : 1;
+    return insert_user(m_pool, conn, name, passwd);
+}
+
+bool user_mysql::need_conn()
+{
+    return !user_journal::get_instance()->enabled();
+}
+
+void user_mysql::stop()
+{
+    //把日志中剩余的注册写入数据库
+    user_journal::get_instance()->stop();
+}
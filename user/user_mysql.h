@@ -0,0 +1,33 @@
+/*************************************************************
+*MySQL 后端：启动时用多个连接并行载入 user 表，注册时用预编译语句插入
+*开启注册写回(user_journal)后注册只追加本地日志，由写回线程批量写入数据库
+**************************************************************/
+
+#ifndef USER_MYSQL_H
+#define USER_MYSQL_H
+
+#include <string>
+#include "user_backend.h"
+#include "../CGImysql/sql_connection_pool.h"
+
+class user_mysql : public user_backend
+{
+public:
+    //load_threads 个连接并行载入；snapshot 非空时先映射快照，只从数据库读取快照之后新增的行
+    //journal 非空时开启注册写回
+    user_mysql(connection_pool *pool, int load_threads = 4, const char *snapshot = NULL, const char *journal = NULL);
+
+    const char *name() { return "mysql"; }
+    bool load(user_store *users);
+    int insert(const char *name, const char *passwd, MYSQL *conn);
+    bool need_conn();
+    void stop();
+
+private:
+    connection_pool *m_pool;
+    int m_load_threads;
+    const char *m_snapshot;
+    const char *m_journal;
+};
+
+#endif
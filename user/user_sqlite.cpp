@@ -0,0 +1,106 @@
+#include "user_sqlite.h"
+#include "../log/log.h"
+#include "../timer/coarse_clock.h"
+
+user_sqlite::user_sqlite(const char *path) : m_path(path)
+{
+    m_db = NULL;
+    m_insert = NULL;
+}
+
+user_sqlite::~user_sqlite()
+{
+    stop();
+}
+
+bool user_sqlite::exec(const char *sql)
+{
+    char *err = NULL;
+    if (sqlite3_exec(m_db, sql, NULL, NULL, &err) == SQLITE_OK)
+        return true;
+    LOG_ERROR("sqlite %s: %s", sql, err ? err : sqlite3_errmsg(m_db));
+    sqlite3_free(err);
+    return false;
+}
+
+bool user_sqlite::load(user_store *users)
+{
+    long long start = coarse_clock::monotonic_us();
+    //连接由 m_lock 串行使用，不需要 SQLite 内部的互斥
+    if (sqlite3_open_v2(m_path.c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+    {
+        LOG_ERROR("open sqlite %s: %s", m_path.c_str(), m_db ? sqlite3_errmsg(m_db) : "out of memory");
+        sqlite3_close(m_db);
+        m_db = NULL;
+        return false;
+    }
+    sqlite3_busy_timeout(m_db, 1000);
+    if (!exec("PRAGMA journal_mode=WAL") || !exec("PRAGMA synchronous=NORMAL") ||
+        !exec("CREATE TABLE IF NOT EXISTS user(username TEXT PRIMARY KEY, passwd TEXT NOT NULL)"))
+        return false;
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, "SELECT COUNT(*) FROM user", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        users->reserve(sqlite3_column_int64(stmt, 0));
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(m_db, "SELECT username, passwd FROM user", -1, &stmt, NULL) != SQLITE_OK)
+    {
+        LOG_ERROR("sqlite SELECT error:%s", sqlite3_errmsg(m_db));
+        return false;
+    }
+    long long rows = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        const char *passwd = (const char *)sqlite3_column_text(stmt, 1);
+        if (name && passwd)
+            users->insert_if_absent(name, passwd);
+        ++rows;
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE)
+    {
+        LOG_ERROR("sqlite SELECT error:%s", sqlite3_errmsg(m_db));
+        return false;
+    }
+
+    if (sqlite3_prepare_v2(m_db, "INSERT INTO user(username, passwd) VALUES(?, ?)", -1, &m_insert, NULL) != SQLITE_OK)
+    {
+        LOG_ERROR("sqlite prepare error:%s", sqlite3_errmsg(m_db));
+        return false;
+    }
+    LOG_INFO("loaded %lld users from sqlite %s in %lld ms", rows, m_path.c_str(),
+             (coarse_clock::monotonic_us() - start) / 1000);
+    return true;
+}
+
+int user_sqlite::insert(const char *name, const char *passwd, MYSQL *)
+{
+    m_lock.lock();
+    int rc = SQLITE_MISUSE;
+    if (m_insert)
+    {
+        sqlite3_bind_text(m_insert, 1, name, -1, SQLITE_STATIC);
+        sqlite3_bind_text(m_insert, 2, passwd, -1, SQLITE_STATIC);
+        rc = sqlite3_step(m_insert);
+        sqlite3_reset(m_insert);
+        sqlite3_clear_bindings(m_insert);
+        if (rc != SQLITE_DONE)
+            LOG_ERROR("sqlite INSERT error:%s", sqlite3_errmsg(m_db));
+    }
+    m_lock.unlock();
+    return rc == SQLITE_DONE ? 0 : 1;
+}
+
+void user_sqlite::stop()
+{
+    m_lock.lock();
+    sqlite3_finalize(m_insert);
+    m_insert = NULL;
+    //关闭最后一个连接时 SQLite 把 WAL 合并回数据库文件
+    sqlite3_close(m_db);
+    m_db = NULL;
+    m_lock.unlock();
+}
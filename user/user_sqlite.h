@@ -0,0 +1,37 @@
+/*************************************************************
+*SQLite 后端：用户表存放在本地数据库文件中，不需要 MySQL 服务
+*WAL 模式 + synchronous=NORMAL：提交不等待 fsync，进程崩溃不丢数据，掉电可能丢失最近的注册
+*只有一个连接，注册在工作线程上加锁串行插入，单次插入约十几微秒
+**************************************************************/
+
+#ifndef USER_SQLITE_H
+#define USER_SQLITE_H
+
+#include <string>
+#include <sqlite3.h>
+#include "user_backend.h"
+#include "../lock/locker.h"
+
+class user_sqlite : public user_backend
+{
+public:
+    user_sqlite(const char *path);
+    ~user_sqlite();
+
+    const char *name() { return "sqlite"; }
+    //打开(不存在时创建)数据库文件和 user 表，载入全部用户
+    bool load(user_store *users);
+    int insert(const char *name, const char *passwd, MYSQL *conn);
+    void stop();
+
+private:
+    bool exec(const char *sql);
+
+private:
+    std::string m_path;
+    sqlite3 *m_db;
+    sqlite3_stmt *m_insert;
+    locker m_lock;          //保护 m_db 和 m_insert
+};
+
+#endif
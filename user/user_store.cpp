@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "user_store.h"
+using namespace std;
+
+static const char SNAPSHOT_MAGIC[8] = {'W', 'S', 'U', 'S', 'E', 'R', '1', '\n'};
+
+user_store::user_store(int shard_bits)
+{
+    if (shard_bits < 1)
+        shard_bits = 1;
+    if (shard_bits > 16)
+        shard_bits = 16;
+    m_shard_count = 1 << shard_bits;
+    m_shift = 64 - shard_bits;
+    m_shards = new user_shard[m_shard_count];
+    for (int i = 0; i < m_shard_count; ++i)
+    {
+        user_shard &s = m_shards[i];
+        s.m_table = new user_entry[MIN_CAPACITY]();
+        s.m_mask = MIN_CAPACITY - 1;
+        s.m_size = 0;
+        s.m_cur = NULL;
+        s.m_left = 0;
+        s.m_arena_bytes = 0;
+    }
+    m_snap = NULL;
+    m_snap_len = 0;
+    m_snap_table = NULL;
+    m_snap_mask = 0;
+    m_snap_count = 0;
+}
+
+user_store::~user_store()
+{
+    for (int i = 0; i < m_shard_count; ++i)
+    {
+        delete[] m_shards[i].m_table;
+        for (size_t j = 0; j < m_shards[i].m_blocks.size(); ++j)
+            delete[] m_shards[i].m_blocks[j];
+    }
+    delete[] m_shards;
+    if (m_snap)
+        munmap(m_snap, m_snap_len);
+}
+
+//FNV-1a 后再混合一次，使高位(选分片)和低位(选槽位)都分布均匀
+uint64_t user_store::hash(const char *s, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+user_store::user_entry *user_store::lookup(user_shard &s, uint64_t h, const char *name, size_t len)
+{
+    for (size_t i = h & s.m_mask;; i = (i + 1) & s.m_mask)
+    {
+        user_entry &e = s.m_table[i];
+        if (e.m_hash == 0)
+            return NULL;
+        if (e.m_hash == h && e.m_name_len == len && memcmp(e.m_name, name, len) == 0)
+            return &e;
+    }
+}
+
+const char *user_store::passwd_of(const user_entry &e)
+{
+    if (e.m_passwd_len <= INLINE_LEN)
+        return e.m_passwd;
+    const char *p;
+    memcpy(&p, e.m_passwd, sizeof(p));
+    return p;
+}
+
+const user_store::snapshot_entry *user_store::snapshot_lookup(uint64_t h, const char *name, size_t len)
+{
+    if (!m_snap)
+        return NULL;
+    for (size_t i = h & m_snap_mask;; i = (i + 1) & m_snap_mask)
+    {
+        const snapshot_entry &e = m_snap_table[i];
+        if (e.m_hash == 0)          //载入时已确认至少有一个空位
+            return NULL;
+        if (e.m_hash == h && e.m_name_len == len && e.m_name + len <= m_snap_len &&
+            memcmp(m_snap + e.m_name, name, len) == 0)
+            return &e;
+    }
+}
+
+const char *user_store::snapshot_passwd(const snapshot_entry &e)
+{
+    if (e.m_passwd_len <= INLINE_LEN)
+        return e.m_passwd;
+    uint64_t off;
+    memcpy(&off, e.m_passwd, sizeof(off));
+    //偏移越界说明文件损坏，当作密码不匹配
+    return off + e.m_passwd_len <= m_snap_len ? m_snap + off : NULL;
+}
+
+//用户只增不删(erase 很少发生，其用户名所占的空间不回收)，内存池只需顺序分配
+char *user_store::arena_alloc(user_shard &s, size_t n)
+{
+    if (n > s.m_left)
+    {
+        size_t size = n > ARENA_BLOCK ? n : ARENA_BLOCK;
+        s.m_cur = new char[size];
+        s.m_left = size;
+        s.m_blocks.push_back(s.m_cur);
+        s.m_arena_bytes += size;
+    }
+    char *p = s.m_cur;
+    s.m_cur += n;
+    s.m_left -= n;
+    return p;
+}
+
+void user_store::grow(user_shard &s, size_t capacity)
+{
+    user_entry *old = s.m_table;
+    size_t old_cap = s.m_mask + 1;
+    s.m_table = new user_entry[capacity]();
+    s.m_mask = capacity - 1;
+    for (size_t i = 0; i < old_cap; ++i)
+    {
+        if (old[i].m_hash == 0)
+            continue;
+        size_t j = old[i].m_hash & s.m_mask;
+        while (s.m_table[j].m_hash != 0)
+            j = (j + 1) & s.m_mask;
+        s.m_table[j] = old[i];
+    }
+    delete[] old;
+}
+
+bool user_store::insert_if_absent(const char *name, const char *passwd)
+{
+    size_t len = strlen(name);
+    size_t plen = strlen(passwd);
+    if (len > MAX_NAME_LEN || plen > MAX_PASSWD_LEN)
+        return false;
+    uint64_t h = hash(name, len);
+    if (snapshot_lookup(h, name, len))
+        return false;
+    user_shard &s = shard_of(h);
+
+    s.m_lock.wrlock();
+    if (lookup(s, h, name, len))
+    {
+        s.m_lock.unlock();
+        return false;
+    }
+    //负载因子不超过 0.75
+    if ((s.m_size + 1) * 4 > (s.m_mask + 1) * 3)
+        grow(s, (s.m_mask + 1) * 2);
+
+    size_t i = h & s.m_mask;
+    while (s.m_table[i].m_hash != 0)
+        i = (i + 1) & s.m_mask;
+    user_entry &e = s.m_table[i];
+    char *key = arena_alloc(s, len);
+    memcpy(key, name, len);
+    e.m_name = key;
+    e.m_name_len = len;
+    e.m_passwd_len = plen;
+    if (plen <= INLINE_LEN)
+        memcpy(e.m_passwd, passwd, plen);
+    else
+    {
+        char *p = arena_alloc(s, plen);
+        memcpy(p, passwd, plen);
+        memcpy(e.m_passwd, &p, sizeof(p));
+    }
+    e.m_hash = h;
+    ++s.m_size;
+    s.m_lock.unlock();
+    return true;
+}
+
+bool user_store::check(const char *name, const char *passwd)
+{
+    size_t len = strlen(name);
+    size_t plen = strlen(passwd);
+    uint64_t h = hash(name, len);
+    const snapshot_entry *se = snapshot_lookup(h, name, len);
+    if (se)
+    {
+        const char *p = snapshot_passwd(*se);
+        return p && se->m_passwd_len == plen && memcmp(p, passwd, plen) == 0;
+    }
+    user_shard &s = shard_of(h);
+
+    s.m_lock.rdlock();
+    user_entry *e = lookup(s, h, name, len);
+    bool ok = e && e->m_passwd_len == plen &&
+              memcmp(passwd_of(*e), passwd, plen) == 0;
+    s.m_lock.unlock();
+    return ok;
+}
+
+bool user_store::contains(const char *name)
+{
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    if (snapshot_lookup(h, name, len))
+        return true;
+    user_shard &s = shard_of(h);
+
+    s.m_lock.rdlock();
+    bool ok = lookup(s, h, name, len) != NULL;
+    s.m_lock.unlock();
+    return ok;
+}
+
+bool user_store::find(const char *name, string *passwd)
+{
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    const snapshot_entry *se = snapshot_lookup(h, name, len);
+    if (se)
+    {
+        const char *p = snapshot_passwd(*se);
+        if (!p)
+            return false;
+        passwd->assign(p, se->m_passwd_len);
+        return true;
+    }
+    user_shard &s = shard_of(h);
+
+    s.m_lock.rdlock();
+    user_entry *e = lookup(s, h, name, len);
+    if (e)
+        passwd->assign(passwd_of(*e), e->m_passwd_len);
+    s.m_lock.unlock();
+    return e != NULL;
+}
+
+//线性探测表的删除：把后面同一探测链上的表项前移，不使用墓碑
+//快照是只读的，只能删除快照之后加入的用户
+bool user_store::erase(const char *name)
+{
+    size_t len = strlen(name);
+    uint64_t h = hash(name, len);
+    user_shard &s = shard_of(h);
+
+    s.m_lock.wrlock();
+    user_entry *e = lookup(s, h, name, len);
+    if (!e)
+    {
+        s.m_lock.unlock();
+        return false;
+    }
+    size_t hole = e - s.m_table;
+    for (size_t i = (hole + 1) & s.m_mask; s.m_table[i].m_hash != 0; i = (i + 1) & s.m_mask)
+    {
+        //表项的理想位置不在 (hole, i] 之间时才能移到空位上
+        size_t home = s.m_table[i].m_hash & s.m_mask;
+        if (((i - home) & s.m_mask) >= ((i - hole) & s.m_mask))
+        {
+            s.m_table[hole] = s.m_table[i];
+            hole = i;
+        }
+    }
+    s.m_table[hole].m_hash = 0;
+    --s.m_size;
+    s.m_lock.unlock();
+    return true;
+}
+
+void user_store::reserve(size_t users)
+{
+    size_t per_shard = users / m_shard_count + 1;
+    size_t capacity = MIN_CAPACITY;
+    while (capacity * 3 < per_shard * 4)
+        capacity *= 2;
+    for (int i = 0; i < m_shard_count; ++i)
+    {
+        user_shard &s = m_shards[i];
+        s.m_lock.wrlock();
+        if (capacity > s.m_mask + 1)
+            grow(s, capacity);
+        s.m_lock.unlock();
+    }
+}
+
+size_t user_store::size()
+{
+    size_t n = m_snap_count;
+    for (int i = 0; i < m_shard_count; ++i)
+    {
+        m_shards[i].m_lock.rdlock();
+        n += m_shards[i].m_size;
+        m_shards[i].m_lock.unlock();
+    }
+    return n;
+}
+
+size_t user_store::memory_usage()
+{
+    size_t n = sizeof(user_shard) * m_shard_count;
+    for (int i = 0; i < m_shard_count; ++i)
+    {
+        m_shards[i].m_lock.rdlock();
+        n += (m_shards[i].m_mask + 1) * sizeof(user_entry) + m_shards[i].m_arena_bytes;
+        m_shards[i].m_lock.unlock();
+    }
+    return n;
+}
+
+bool user_store::load_snapshot(const char *path, long long *watermark)
+{
+    if (m_snap || size() != 0)
+        return false;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(snapshot_head))
+    {
+        close(fd);
+        return false;
+    }
+    size_t len = st.st_size;
+    char *base = (char *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    //页在首次查找时才读入，提示内核提前异步预读
+    const snapshot_head *head = (const snapshot_head *)base;
+    uint64_t cap = head->m_capacity;
+    if (memcmp(head->m_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || head->m_size != len ||
+        cap < MIN_CAPACITY || (cap & (cap - 1)) != 0 || head->m_count >= cap ||
+        head->m_table != sizeof(snapshot_head) || head->m_strings != head->m_table + cap * sizeof(snapshot_entry) ||
+        head->m_strings > len)
+    {
+        munmap(base, len);
+        return false;
+    }
+    madvise(base, len, MADV_WILLNEED);
+
+    //至少有一个空位，否则 snapshot_lookup 查不存在的用户名时会一直探测下去
+    const snapshot_entry *table = (const snapshot_entry *)(base + head->m_table);
+    uint64_t empty = 0;
+    while (empty < cap && table[empty].m_hash != 0)
+        ++empty;
+    if (empty == cap)
+    {
+        munmap(base, len);
+        return false;
+    }
+
+    m_snap_table = table;
+    m_snap_mask = cap - 1;
+    m_snap_count = head->m_count;
+    m_snap_len = len;
+    m_snap = base;
+    *watermark = head->m_watermark;
+    return true;
+}
+
+bool user_store::save_snapshot(const char *path, long long watermark)
+{
+    //锁住全部分片，保证快照是同一时刻的内容；登录只加读锁，不受影响
+    for (int i = 0; i < m_shard_count; ++i)
+        m_shards[i].m_lock.rdlock();
+
+    size_t count = m_snap_count, strings = 0;
+    for (size_t i = 0; m_snap && i <= m_snap_mask; ++i)
+    {
+        const snapshot_entry &e = m_snap_table[i];
+        if (e.m_hash)
+            strings += e.m_name_len + (e.m_passwd_len > INLINE_LEN ? e.m_passwd_len : 0);
+    }
+    for (int i = 0; i < m_shard_count; ++i)
+    {
+        user_shard &s = m_shards[i];
+        count += s.m_size;
+        for (size_t j = 0; j <= s.m_mask; ++j)
+        {
+            const user_entry &e = s.m_table[j];
+            if (e.m_hash)
+                strings += e.m_name_len + (e.m_passwd_len > INLINE_LEN ? e.m_passwd_len : 0);
+        }
+    }
+    size_t cap = MIN_CAPACITY;
+    while (cap * 3 < count * 4 + 4)
+        cap *= 2;
+    size_t table = sizeof(snapshot_head);
+    size_t str_off = table + cap * sizeof(snapshot_entry);
+    size_t len = str_off + strings;
+
+    string tmp = string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    char *base = (char *)MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, len) == 0)
+        base = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        for (int i = 0; i < m_shard_count; ++i)
+            m_shards[i].m_lock.unlock();
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp.c_str());
+        }
+        return false;
+    }
+
+    //ftruncate 扩展出的部分全为 0，即空表
+    snapshot_entry *out = (snapshot_entry *)(base + table);
+    size_t mask = cap - 1;
+    size_t cursor = str_off;
+    auto put = [&](uint64_t h, const char *name, size_t nlen, const char *pw, size_t plen) {
+        size_t i = h & mask;
+        while (out[i].m_hash != 0)
+            i = (i + 1) & mask;
+        snapshot_entry &e = out[i];
+        memcpy(base + cursor, name, nlen);
+        e.m_name = cursor;
+        cursor += nlen;
+        e.m_name_len = nlen;
+        e.m_passwd_len = plen;
+        if (plen <= INLINE_LEN)
+            memcpy(e.m_passwd, pw, plen);
+        else
+        {
+            uint64_t off = cursor;
+            memcpy(base + cursor, pw, plen);
+            cursor += plen;
+            memcpy(e.m_passwd, &off, sizeof(off));
+        }
+        e.m_hash = h;
+    };
+    for (size_t i = 0; m_snap && i <= m_snap_mask; ++i)
+    {
+        const snapshot_entry &e = m_snap_table[i];
+        const char *pw = snapshot_passwd(e);
+        if (e.m_hash && pw)
+            put(e.m_hash, m_snap + e.m_name, e.m_name_len, pw, e.m_passwd_len);
+    }
+    for (int i = 0; i < m_shard_count; ++i)
+    {
+        user_shard &s = m_shards[i];
+        for (size_t j = 0; j <= s.m_mask; ++j)
+        {
+            const user_entry &e = s.m_table[j];
+            if (e.m_hash)
+                put(e.m_hash, e.m_name, e.m_name_len, passwd_of(e), e.m_passwd_len);
+        }
+    }
+    for (int i = 0; i < m_shard_count; ++i)
+        m_shards[i].m_lock.unlock();
+
+    snapshot_head *head = (snapshot_head *)base;
+    memcpy(head->m_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    head->m_count = count;
+    head->m_capacity = cap;
+    head->m_table = table;
+    head->m_strings = str_off;
+    head->m_size = len;
+    head->m_watermark = watermark;
+
+    bool ok = munmap(base, len) == 0 && fsync(fd) == 0;
+    close(fd);
+    if (ok && rename(tmp.c_str(), path) == 0)
+        return true;
+    unlink(tmp.c_str());
+    return false;
+}
@@ -0,0 +1,132 @@
+/*************************************************************
+*用户名 -> 密码 的并发哈希表，替代全局 map + 互斥锁
+*按哈希值分片，每个分片一把读写锁：登录只加读锁，注册加写锁
+*分片内为线性探测的开放寻址表，用户名存放在分片的内存池中，
+*不超过 INLINE_LEN 字节的密码直接存放在表项中
+*
+*快照文件可直接 mmap 作为只读的基础层，启动时不必逐个插入：
+*  [snapshot_head][snapshot_entry * capacity][字符串区]
+*基础层是一张不分片的开放寻址表，偏移相对文件起始，按本机字节序存放
+*查找先查基础层(不加锁)，再查分片；新用户只写入分片
+**************************************************************/
+
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../lock/locker.h"
+
+class user_store
+{
+public:
+    //用户名和密码的最大长度，超长的注册请求直接拒绝
+    static const int MAX_NAME_LEN = 255;
+    static const int MAX_PASSWD_LEN = 255;
+
+    //分片数为 2^shard_bits
+    user_store(int shard_bits = 6);
+    ~user_store();
+
+    static user_store *get_instance()
+    {
+        static user_store instance;
+        return &instance;
+    }
+
+    //用户名不存在时插入并返回 true，已存在时不修改并返回 false
+    bool insert_if_absent(const char *name, const char *passwd);
+    //用户名存在且密码一致，比较在读锁内完成，不拷贝密码
+    bool check(const char *name, const char *passwd);
+    bool contains(const char *name);
+    bool find(const char *name, std::string *passwd);
+    bool erase(const char *name);
+    //预估用户数，加载大表前调用以避免多次扩容
+    void reserve(size_t users);
+    size_t size();
+    //分片和内存池占用的字节数，不含快照
+    size_t memory_usage();
+
+    //映射快照作为基础层，只能在空表上、服务开始前调用；watermark 为保存时记录的数据库进度
+    bool load_snapshot(const char *path, long long *watermark);
+    //把基础层和分片中的全部用户写入新快照(先写临时文件再 rename)，保存期间注册会等待
+    bool save_snapshot(const char *path, long long watermark);
+    //基础层中的用户数
+    size_t snapshot_size() { return m_snap_count; }
+
+private:
+    static const int INLINE_LEN = 14;
+    static const size_t ARENA_BLOCK = 256 * 1024;
+    static const size_t MIN_CAPACITY = 16;
+
+    //32 字节，一条缓存行放两个表项
+    struct user_entry
+    {
+        uint64_t m_hash;            //0 表示空位
+        const char *m_name;         //指向内存池，不以 '\0' 结尾
+        uint8_t m_name_len;
+        uint8_t m_passwd_len;
+        char m_passwd[INLINE_LEN];  //短密码直接存放；长密码存放在内存池，这里保存其指针
+    };
+
+    //快照中的表项，与 user_entry 布局相同，指针换成相对文件起始的偏移
+    struct snapshot_entry
+    {
+        uint64_t m_hash;
+        uint64_t m_name;
+        uint8_t m_name_len;
+        uint8_t m_passwd_len;
+        char m_passwd[INLINE_LEN];
+    };
+
+    struct snapshot_head
+    {
+        char m_magic[8];
+        uint64_t m_count;
+        uint64_t m_capacity;        //2 的幂
+        uint64_t m_table;           //表的偏移
+        uint64_t m_strings;         //字符串区的偏移
+        uint64_t m_size;            //文件总长度
+        int64_t m_watermark;
+        uint64_t m_reserved;
+    };
+
+    //各分片的锁独占缓存行，避免不同分片的读者互相干扰
+    struct alignas(64) user_shard
+    {
+        rwlocker m_lock;
+        user_entry *m_table;
+        size_t m_mask;              //容量 - 1，容量为 2 的幂
+        size_t m_size;
+        std::vector<char *> m_blocks;
+        char *m_cur;                //当前内存块中的空闲位置
+        size_t m_left;
+        size_t m_arena_bytes;
+    };
+
+    static uint64_t hash(const char *s, size_t len);
+    user_shard &shard_of(uint64_t h) { return m_shards[h >> m_shift]; }
+    //以下函数在持有分片锁时调用
+    user_entry *lookup(user_shard &s, uint64_t h, const char *name, size_t len);
+    static const char *passwd_of(const user_entry &e);
+    //快照只读，不需要加锁
+    const snapshot_entry *snapshot_lookup(uint64_t h, const char *name, size_t len);
+    const char *snapshot_passwd(const snapshot_entry &e);
+    char *arena_alloc(user_shard &s, size_t n);
+    void grow(user_shard &s, size_t capacity);
+
+private:
+    int m_shard_count;
+    int m_shift;                    //哈希值的高位选择分片，低位选择槽位
+    user_shard *m_shards;
+
+    char *m_snap;                   //映射的快照，NULL 表示没有基础层
+    size_t m_snap_len;
+    const snapshot_entry *m_snap_table;
+    size_t m_snap_mask;
+    size_t m_snap_count;
+};
+
+#endif